@@ -37,6 +37,15 @@ public:
   template<typename T>
   T GetValue(void) const;
 
+  // Description:
+  // Append a binary representation of the attribute to a buffer
+  void Serialize(std::vector<char>& buf) const;
+
+  // Description:
+  // Reconstruct an attribute previously serialized into a buffer, advancing
+  // pos past it
+  static ADIOSAttribute* Deserialize(const char*& pos, const char* end);
+
 private:
   ADIOSAttributeImpl *Impl;
 };
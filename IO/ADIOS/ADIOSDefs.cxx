@@ -13,8 +13,32 @@ const std::string&  ToString(TransportMethod method)
 
 const std::string& ToString(Transform xfm)
 {
-  static const std::string valueMap[] = { "", "zlib", "bzlib2", "szip" };
+  static const std::string valueMap[] = { "", "zlib", "bzlib2", "szip",
+    "zfp", "sz" };
   return valueMap[xfm];
 }
 
+bool IsLossy(Transform xfm)
+{
+  return xfm == Transform_ZFP || xfm == Transform_SZ;
+}
+
+const std::string& ToString(ErrorBound bound)
+{
+  static const std::string valueMap[] = { "Absolute", "Relative", "Rate" };
+  return valueMap[bound];
+}
+
+const std::string& ToString(CellEncoding encoding)
+{
+  static const std::string valueMap[] = { "Legacy", "Compact", "Delta" };
+  return valueMap[encoding];
+}
+
+const std::string& ToString(SyncPolicy policy)
+{
+  static const std::string valueMap[] = { "Barrier", "None", "Deferred" };
+  return valueMap[policy];
+}
+
 }
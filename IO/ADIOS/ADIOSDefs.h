@@ -27,9 +27,36 @@ enum Transform
   Transform_NONE   = 0,
   Transform_ZLIB   = 1,
   Transform_BZLIB2 = 2,
-  Transform_SZIP   = 3
+  Transform_SZIP   = 3,
+  Transform_ZFP    = 4, // Lossy, floating point only
+  Transform_SZ     = 5  // Lossy, floating point only
 };
 const std::string& ToString(Transform);
+bool IsLossy(Transform);
+
+enum ErrorBound
+{
+  ErrorBound_Absolute = 0, // Maximum absolute error
+  ErrorBound_Relative = 1, // Maximum error relative to the value range
+  ErrorBound_Rate     = 2  // Fixed number of bits per value
+};
+const std::string& ToString(ErrorBound);
+
+enum CellEncoding
+{
+  CellEncoding_Legacy  = 0, // vtkIdType (npts, id, id, ...) stream
+  CellEncoding_Compact = 1, // 32-bit ids, no counts for uniform cell sizes
+  CellEncoding_Delta   = 2  // Zigzag varint deltas between successive ids
+};
+const std::string& ToString(CellEncoding);
+
+enum SyncPolicy
+{
+  SyncPolicy_Barrier  = 0, // Synchronize all ranks on every close
+  SyncPolicy_None     = 1, // Never explicitly synchronize
+  SyncPolicy_Deferred = 2  // Synchronize once at finalization
+};
+const std::string& ToString(SyncPolicy);
 
 } // end namespace
 #endif //__ADIOSDefs_h
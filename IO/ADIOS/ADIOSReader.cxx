@@ -12,12 +12,21 @@
      PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
-#include <cstdlib> // std::free
+#include <cstdio> // std::remove, std::rename
+#include <cstdlib> // std::free, std::rand
+#include <cstring>
 
+#include <algorithm>
+#include <climits>
+#include <fstream>
 #include <stdexcept>
 #include <map>
+#include <sstream>
 #include <utility>
 
+#include <sys/stat.h>
+#include <unistd.h> // getpid
+
 #include "ADIOSReader.h"
 #include "ADIOSReaderImpl.h"
 #include "ADIOSUtilities.h"
@@ -25,6 +34,32 @@
 
 typedef std::map<std::string, int> IdMap;
 
+// Sidecar metadata index header: magic, format version, and the size and
+// modification time of the file it was saved for
+static const uint32_t INDEX_MAGIC = 0x58444956; // "VIDX"
+static const uint32_t INDEX_VERSION = 1;
+static const size_t INDEX_HEADER_SIZE = 24;
+
+//----------------------------------------------------------------------------
+static std::string GetIndexFileName(const std::string& fileName)
+{
+  return fileName + ".vtkidx";
+}
+
+//----------------------------------------------------------------------------
+static bool StatFile(const std::string& fileName, uint64_t& size,
+  int64_t& mtime)
+{
+  struct stat st;
+  if(stat(fileName.c_str(), &st) != 0)
+    {
+    return false;
+    }
+  size = static_cast<uint64_t>(st.st_size);
+  mtime = static_cast<int64_t>(st.st_mtime);
+  return true;
+}
+
 //----------------------------------------------------------------------------
 struct ADIOSAttributeImpl
 {
@@ -89,6 +124,39 @@ INSTANTIATE(float)
 INSTANTIATE(double)
 #undef INSTANTIATE
 
+void ADIOSAttribute::Serialize(std::vector<char>& buf) const
+{
+  ADIOSUtilities::Pack<int32_t>(buf, this->Impl->Id);
+  ADIOSUtilities::Pack(buf, this->Impl->Name);
+  ADIOSUtilities::Pack<int32_t>(buf, this->Impl->Size);
+  ADIOSUtilities::Pack<int32_t>(buf, this->Impl->Type);
+  const char *data = reinterpret_cast<const char*>(this->Impl->Data);
+  buf.insert(buf.end(), data, data+this->Impl->Size);
+}
+
+ADIOSAttribute* ADIOSAttribute::Deserialize(const char*& pos,
+  const char* end)
+{
+  int32_t id, size, type;
+  std::string name;
+  ADIOSUtilities::Unpack(pos, end, id);
+  ADIOSUtilities::Unpack(pos, end, name);
+  ADIOSUtilities::Unpack(pos, end, size);
+  ADIOSUtilities::Unpack(pos, end, type);
+  if(size < 0 || end - pos < size)
+    {
+    throw std::runtime_error("Truncated metadata buffer");
+    }
+
+  // Allocated with malloc to match the memory ADIOS hands out
+  void *data = std::malloc(size);
+  std::memcpy(data, pos, size);
+  pos += size;
+
+  return new ADIOSAttribute(new ADIOSAttributeImpl(id, name.c_str(), size,
+    static_cast<ADIOS_DATATYPES>(type), data));
+}
+
 //----------------------------------------------------------------------------
 ADIOSReader::ADIOSReader(void)
 : Impl(new ADIOSReaderImpl)
@@ -104,14 +172,33 @@ ADIOSReader::~ADIOSReader(void)
 {
   int err;
 
+  this->ClearMetadata();
+
   if(this->Impl->File != NULL)
     {
+    // Let any prefetched data land before the file goes away
+    try
+      {
+      this->WaitForReads();
+      }
+    catch(const std::runtime_error&)
+      {
+      }
     adios_read_close(this->Impl->File);
     }
+  if(this->Impl->Threader)
+    {
+    this->Impl->Threader->Delete();
+    }
 
-  int rank = 0;
-  MPI_Comm_rank(ADIOSReader::ADIOSReaderImpl::Comm, &rank);
-  MPI_Barrier(ADIOSReader::ADIOSReaderImpl::Comm);
+  // The reader only closes at finalization so both the per-close and the
+  // deferred policies synchronize here
+  if(this->Impl->SyncPolicy != ADIOS::SyncPolicy_None)
+    {
+    double t0 = MPI_Wtime();
+    MPI_Barrier(ADIOSReader::ADIOSReaderImpl::Comm);
+    ADIOSReader::ADIOSReaderImpl::SyncWaitTime += MPI_Wtime() - t0;
+    }
 
   adios_read_finalize_method(ADIOS_READ_METHOD_BP);
 }
@@ -122,15 +209,18 @@ bool ADIOSReader::Initialize(MPI_Comm comm, ADIOS_READ_METHOD method,
 {
   if(ADIOSReader::ADIOSReaderImpl::Comm != INVALID_MPI_COMM)
     {
-    return ADIOSReader::ADIOSReaderImpl::Comm == comm;
+    return ADIOSReader::ADIOSReaderImpl::UserComm == comm;
     }
 
+  ADIOSReader::ADIOSReaderImpl::UserComm = comm;
+  MPI_Comm_dup(comm, &ADIOSReader::ADIOSReaderImpl::Comm);
   ADIOSReader::ADIOSReaderImpl::Method = static_cast<ADIOS_READ_METHOD>(method);
 
   int err;
   err = adios_read_init_method(ADIOSReader::ADIOSReaderImpl::Method,
     ADIOSReader::ADIOSReaderImpl::Comm, methodArgs.c_str());
   ADIOSUtilities::TestReadErrorEq<int>(0, err);
+  return true;
 }
 
 //----------------------------------------------------------------------------
@@ -142,7 +232,12 @@ void ADIOSReader::OpenFile(const std::string &fileName)
     throw std::runtime_error("ADIOSReader already has an open file.");
     }
 
-  int err;
+  // Identify the file's contents before opening it so that an index saved
+  // from it can never describe anything newer
+  uint64_t fileSize = 0;
+  int64_t fileMTime = 0;
+  bool useIndex = this->Impl->MetadataIndex &&
+    StatFile(fileName, fileSize, fileMTime);
 
   // Open the file
   this->Impl->File = adios_read_open(fileName.c_str(),
@@ -154,24 +249,90 @@ void ADIOSReader::OpenFile(const std::string &fileName)
   this->Impl->StepRange.first = this->Impl->File->current_step;
   this->Impl->StepRange.second = this->Impl->File->last_step;
 
-  // Preload the scalar data and cache the array metadata
-  for(int i = 0; i < this->Impl->File->nvars; ++i)
+  int rank;
+  MPI_Comm_rank(ADIOSReader::ADIOSReaderImpl::Comm, &rank);
+
+  std::vector<char> buf;
+  if(!this->Impl->BroadcastMetadata)
     {
-      ADIOS_VARINFO *v = adios_inq_var_byid(this->Impl->File, i);
-      ADIOSUtilities::TestReadErrorNe<void*>(NULL, v);
+    if(useIndex && this->LoadMetadataIndex(fileName, fileSize, fileMTime,
+      buf))
+      {
+      return;
+      }
+    this->InquireMetadata();
+    if(useIndex && rank == 0)
+      {
+      this->SerializeMetadata(buf);
+      SaveMetadataIndex(fileName, fileSize, fileMTime, buf);
+      }
+    return;
+    }
 
-      std::string name(this->Impl->File->var_namelist[i]);
+  // Only the root process inquires the file, or loads its index; everyone
+  // else rebuilds the metadata from its serialized form
 
-      // Insert into the appropriate scalar or array map
-      if(v->ndim == 0)
-        {
-        this->Impl->Scalars.push_back(new ADIOSVarInfo(name, v));
-        }
-      else
+  // A size of ULLONG_MAX tells the other ranks the root failed so that they
+  // don't wait on a broadcast that never comes
+  unsigned long long bufSize = 0;
+  std::string error;
+  if(rank == 0)
+    {
+    try
+      {
+      if(!useIndex || !this->LoadMetadataIndex(fileName, fileSize,
+        fileMTime, buf))
         {
-        this->Impl->Arrays.push_back(new ADIOSVarInfo(name, v));
-        this->Impl->ArrayIds.insert(std::make_pair(name, i));
+        this->InquireMetadata();
+        this->SerializeMetadata(buf);
+        if(useIndex)
+          {
+          SaveMetadataIndex(fileName, fileSize, fileMTime, buf);
+          }
         }
+      bufSize = buf.size();
+      }
+    catch(const std::exception &e)
+      {
+      error = e.what();
+      bufSize = ULLONG_MAX;
+      }
+    }
+
+  MPI_Bcast(&bufSize, 1, MPI_UNSIGNED_LONG_LONG, 0,
+    ADIOSReader::ADIOSReaderImpl::Comm);
+  if(bufSize == ULLONG_MAX)
+    {
+    throw std::runtime_error(error.empty() ?
+      "Failed to broadcast metadata from the root process" : error);
+    }
+  buf.resize(bufSize);
+
+  // MPI counts are ints so very large metadata goes out in pieces
+  for(size_t off = 0; off < buf.size(); )
+    {
+    size_t n = std::min(buf.size() - off, static_cast<size_t>(INT_MAX));
+    MPI_Bcast(&buf[off], static_cast<int>(n), MPI_BYTE, 0,
+      ADIOSReader::ADIOSReaderImpl::Comm);
+    off += n;
+    }
+
+  if(rank != 0)
+    {
+    this->DeserializeMetadata(buf);
+    }
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::InquireMetadata(void)
+{
+  // Only list the variables; their metadata is inquired on first use
+  for(int i = 0; i < this->Impl->File->nvars; ++i)
+    {
+    std::string name(this->Impl->File->var_namelist[i]);
+    this->Impl->Variables.push_back(
+      new ADIOSVarInfo(name, this->Impl->File, i));
+    this->Impl->VarIds.insert(std::make_pair(name, i));
     }
 
   // Polulate the attribute information
@@ -186,8 +347,198 @@ void ADIOSReader::OpenFile(const std::string &fileName)
       new ADIOSAttributeImpl(id, this->Impl->File->attr_namelist[id], size,
       type, data)));
     }
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::SerializeMetadata(std::vector<char>& buf) const
+{
+  // Serializing a variable inquires it if that hasn't happened yet
+  ADIOSUtilities::Pack<uint64_t>(buf, this->Impl->Variables.size());
+  for(size_t i = 0; i < this->Impl->Variables.size(); ++i)
+    {
+    this->Impl->Variables[i]->Serialize(buf);
+    }
+
+  ADIOSUtilities::Pack<uint64_t>(buf, this->Impl->Attributes.size());
+  for(size_t i = 0; i < this->Impl->Attributes.size(); ++i)
+    {
+    this->Impl->Attributes[i]->Serialize(buf);
+    }
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::DeserializeMetadata(const std::vector<char>& buf)
+{
+  const char *pos = buf.empty() ? NULL : &buf[0];
+  const char *end = pos + buf.size();
+  uint64_t n;
+
+  ADIOSUtilities::Unpack(pos, end, n);
+  for(uint64_t i = 0; i < n; ++i)
+    {
+    ADIOSVarInfo *v = ADIOSVarInfo::Deserialize(pos, end,
+      this->Impl->File);
+    this->Impl->Variables.push_back(v);
+    this->Impl->VarIds.insert(std::make_pair(v->GetName(), v->GetId()));
+    }
 
-  
+  ADIOSUtilities::Unpack(pos, end, n);
+  for(uint64_t i = 0; i < n; ++i)
+    {
+    this->Impl->Attributes.push_back(ADIOSAttribute::Deserialize(pos, end));
+    }
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::ClearMetadata(void)
+{
+  for(size_t i = 0; i < this->Impl->Variables.size(); ++i)
+    {
+    delete this->Impl->Variables[i];
+    }
+  for(size_t i = 0; i < this->Impl->Attributes.size(); ++i)
+    {
+    delete this->Impl->Attributes[i];
+    }
+  this->Impl->Variables.clear();
+  this->Impl->Attributes.clear();
+  this->Impl->VarIds.clear();
+}
+
+//----------------------------------------------------------------------------
+bool ADIOSReader::LoadMetadataIndex(const std::string& fileName,
+  uint64_t fileSize, int64_t fileMTime, std::vector<char>& buf)
+{
+  std::ifstream in(GetIndexFileName(fileName).c_str(),
+    std::ios::in | std::ios::binary);
+  if(!in)
+    {
+    return false;
+    }
+
+  char header[INDEX_HEADER_SIZE];
+  if(!in.read(header, INDEX_HEADER_SIZE))
+    {
+    return false;
+    }
+  const char *pos = header;
+  const char *end = header + INDEX_HEADER_SIZE;
+  uint32_t magic, version;
+  uint64_t size;
+  int64_t mtime;
+  ADIOSUtilities::Unpack(pos, end, magic);
+  ADIOSUtilities::Unpack(pos, end, version);
+  ADIOSUtilities::Unpack(pos, end, size);
+  ADIOSUtilities::Unpack(pos, end, mtime);
+  if(magic != INDEX_MAGIC || version != INDEX_VERSION ||
+    size != fileSize || mtime != fileMTime)
+    {
+    return false;
+    }
+
+  // The rest of the index is the serialized metadata
+  in.seekg(0, std::ios::end);
+  std::streamoff len = static_cast<std::streamoff>(in.tellg()) -
+    static_cast<std::streamoff>(INDEX_HEADER_SIZE);
+  in.seekg(INDEX_HEADER_SIZE, std::ios::beg);
+  buf.resize(len > 0 ? static_cast<size_t>(len) : 0);
+  if(!buf.empty() && !in.read(&buf[0], buf.size()))
+    {
+    buf.clear();
+    return false;
+    }
+
+  try
+    {
+    this->DeserializeMetadata(buf);
+    }
+  catch(const std::runtime_error&)
+    {
+    this->ClearMetadata();
+    buf.clear();
+    return false;
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::SaveMetadataIndex(const std::string& fileName,
+  uint64_t fileSize, int64_t fileMTime, const std::vector<char>& buf)
+{
+  std::vector<char> header;
+  ADIOSUtilities::Pack(header, INDEX_MAGIC);
+  ADIOSUtilities::Pack(header, INDEX_VERSION);
+  ADIOSUtilities::Pack(header, fileSize);
+  ADIOSUtilities::Pack(header, fileMTime);
+
+  // Write to a temporary file first so that readers never see a partial
+  // index.  The name is unique per process so that concurrent jobs opening
+  // the same file don't write over each other's temporary
+  int rank = 0;
+  MPI_Comm_rank(ADIOSReader::ADIOSReaderImpl::Comm, &rank);
+  std::string indexName = GetIndexFileName(fileName);
+  std::ostringstream tmpStr;
+  tmpStr << indexName << ".tmp." << getpid() << "." << rank << "."
+         << std::rand();
+  std::string tmpName = tmpStr.str();
+  std::ofstream out(tmpName.c_str(),
+    std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!out)
+    {
+    return;
+    }
+  out.write(&header[0], header.size());
+  if(!buf.empty())
+    {
+    out.write(&buf[0], buf.size());
+    }
+  out.close();
+  if(!out || std::rename(tmpName.c_str(), indexName.c_str()) != 0)
+    {
+    std::remove(tmpName.c_str());
+    }
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::SetMetadataIndex(bool index)
+{
+  this->Impl->MetadataIndex = index;
+}
+
+//----------------------------------------------------------------------------
+bool ADIOSReader::GetMetadataIndex(void) const
+{
+  return this->Impl->MetadataIndex;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::SetBroadcastMetadata(bool broadcast)
+{
+  this->Impl->BroadcastMetadata = broadcast;
+}
+
+//----------------------------------------------------------------------------
+bool ADIOSReader::GetBroadcastMetadata(void) const
+{
+  return this->Impl->BroadcastMetadata;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::SetSyncPolicy(ADIOS::SyncPolicy policy)
+{
+  this->Impl->SyncPolicy = policy;
+}
+
+//----------------------------------------------------------------------------
+ADIOS::SyncPolicy ADIOSReader::GetSyncPolicy(void) const
+{
+  return this->Impl->SyncPolicy;
+}
+
+//----------------------------------------------------------------------------
+double ADIOSReader::GetSyncWaitTime(void)
+{
+  return ADIOSReader::ADIOSReaderImpl::SyncWaitTime;
 }
 
 //----------------------------------------------------------------------------
@@ -210,15 +561,9 @@ const std::vector<ADIOSAttribute*>& ADIOSReader::GetAttributes(void) const
 }
 
 //----------------------------------------------------------------------------
-const std::vector<ADIOSVarInfo*>& ADIOSReader::GetScalars(void) const
+const std::vector<ADIOSVarInfo*>& ADIOSReader::GetVariables(void) const
 {
-  return this->Impl->Scalars;
-}
-
-//----------------------------------------------------------------------------
-const std::vector<ADIOSVarInfo*>& ADIOSReader::GetArrays(void) const
-{
-  return this->Impl->Arrays;
+  return this->Impl->Variables;
 }
 
 //----------------------------------------------------------------------------
@@ -226,8 +571,8 @@ template<typename T>
 void ADIOSReader::ScheduleReadArray(const std::string &path, T *data, int step,
   int block)
 {
-  IdMap::iterator id = this->Impl->ArrayIds.find(path);
-  if(id != this->Impl->ArrayIds.end())
+  IdMap::iterator id = this->Impl->VarIds.find(path);
+  if(id == this->Impl->VarIds.end())
     {
     throw std::runtime_error("Array " + path + " not found");
     }
@@ -238,6 +583,8 @@ void ADIOSReader::ScheduleReadArray(const std::string &path, T *data, int step,
 template<typename T>
 void ADIOSReader::ScheduleReadArray(int id, T *data, int step, int block)
 {
+  this->WaitForReads();
+
   int err;
   ADIOS_SELECTION *sel;
 
@@ -247,17 +594,44 @@ void ADIOSReader::ScheduleReadArray(int id, T *data, int step, int block)
     MPI_Comm_rank(ADIOSReader::ADIOSReaderImpl::Comm, &block);
     }
   sel = adios_selection_writeblock(block);
+  this->Impl->Selections.push_back(sel);
 
   err = adios_schedule_read_byid(this->Impl->File, sel, id,
     step, 1, data);
   ADIOSUtilities::TestReadErrorEq(0, err);
 }
 
+//----------------------------------------------------------------------------
+template<typename T>
+void ADIOSReader::ScheduleReadArray(int id, T *data, int step,
+  const std::vector<size_t>& start, const std::vector<size_t>& count)
+{
+  if(start.size() != count.size())
+    {
+    throw std::runtime_error("Mismatched bounding box dimensions");
+    }
+  this->WaitForReads();
+
+  std::vector<uint64_t> start64(start.begin(), start.end());
+  std::vector<uint64_t> count64(count.begin(), count.end());
+  ADIOS_SELECTION *sel = adios_selection_boundingbox(start64.size(),
+    &start64[0], &count64[0]);
+  ADIOSUtilities::TestReadErrorNe<void*>(NULL, sel);
+  this->Impl->Selections.push_back(sel);
+
+  int err;
+  err = adios_schedule_read_byid(this->Impl->File, sel, id,
+    step, 1, data);
+  ADIOSUtilities::TestReadErrorEq(0, err);
+}
+
 //----------------------------------------------------------------------------
 // Instantiations for the ScheduleReadArray implementation
 #define INSTANTIATE(T) \
 template void ADIOSReader::ScheduleReadArray<T>(const std::string&, T*, int, int); \
-template void ADIOSReader::ScheduleReadArray<T>(int, T*, int, int);
+template void ADIOSReader::ScheduleReadArray<T>(int, T*, int, int); \
+template void ADIOSReader::ScheduleReadArray<T>(int, T*, int, \
+  const std::vector<size_t>&, const std::vector<size_t>&);
 INSTANTIATE(int8_t)
 INSTANTIATE(int16_t)
 INSTANTIATE(int32_t)
@@ -273,10 +647,76 @@ INSTANTIATE(void)
 #undef INSTANTIATE
 
 //----------------------------------------------------------------------------
-void ADIOSReader::ReadArrays(void)
+void ADIOSReader::ReadArrays(bool blocking)
 {
-  int err;
+  this->WaitForReads();
 
+  // The BP read methods do all of their work inside adios_perform_reads,
+  // even when asked not to block, so background reads need their own thread
+  if(!blocking && this->SupportsBackgroundReads())
+    {
+    if(!this->Impl->Threader)
+      {
+      this->Impl->Threader = vtkMultiThreader::New();
+      }
+    this->Impl->ReadError = 0;
+    this->Impl->ThreadId = this->Impl->Threader->SpawnThread(
+      &ADIOSReaderImpl::ReadThread, this->Impl);
+    this->Impl->PendingReads = true;
+    return;
+    }
+
+  int err;
   err = adios_perform_reads(this->Impl->File, 1);
+  this->ClearSelections();
   ADIOSUtilities::TestReadErrorEq(0, err);
 }
+
+//----------------------------------------------------------------------------
+bool ADIOSReader::SupportsBackgroundReads(void)
+{
+  // The read methods may use MPI, which the calling thread may be using at
+  // the same time
+  int initialized, provided;
+  MPI_Initialized(&initialized);
+  if(!initialized)
+    {
+    return true;
+    }
+  MPI_Query_thread(&provided);
+  return provided == MPI_THREAD_MULTIPLE;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::WaitForReads(void)
+{
+  if(!this->Impl->PendingReads)
+    {
+    return;
+    }
+  this->Impl->PendingReads = false;
+
+  this->Impl->Threader->TerminateThread(this->Impl->ThreadId);
+  this->Impl->ThreadId = -1;
+
+  this->ClearSelections();
+  ADIOSUtilities::TestReadErrorEq(0, this->Impl->ReadError);
+}
+
+//----------------------------------------------------------------------------
+bool ADIOSReader::HasPendingReads(void) const
+{
+  return this->Impl->PendingReads;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSReader::ClearSelections(void)
+{
+  typedef std::vector<ADIOS_SELECTION*>::iterator SelIt;
+  for(SelIt s = this->Impl->Selections.begin();
+    s != this->Impl->Selections.end(); ++s)
+    {
+    adios_selection_delete(*s);
+    }
+  this->Impl->Selections.clear();
+}
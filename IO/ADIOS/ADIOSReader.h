@@ -41,9 +41,25 @@ public:
     const std::string &methodArgs = "");
 
   // Description:
-  // Open the ADIOS file and cache the variable names and scalar data
+  // Open the ADIOS file and cache the variable names and attributes
   void OpenFile(const std::string &fileName);
 
+  // Description:
+  // Get/Set whether only the root process inquires the file's metadata when
+  // opening it and broadcasts the result to the other processes, instead of
+  // every process inquiring every variable.  Must be the same on all ranks.
+  void SetBroadcastMetadata(bool broadcast);
+  bool GetBroadcastMetadata(void) const;
+
+  // Description:
+  // Get/Set whether the file's metadata is cached in a sidecar index file,
+  // <fileName>.vtkidx.  An index recording the same size and modification
+  // time as the file is loaded in place of inquiring the metadata from the
+  // file; otherwise the root process writes a new one once the metadata has
+  // been inquired.  Must be the same on all ranks.
+  void SetMetadataIndex(bool index);
+  bool GetMetadataIndex(void) const;
+
   // Description:
   // Retrieve the total number of seps
   void GetStepRange(int &tStart, int &tEnd) const;
@@ -53,12 +69,9 @@ public:
   const std::vector<ADIOSAttribute*>& GetAttributes(void) const;
 
   // Description:
-  // Retrieve a list of scalars and thier associated metadata
-  const std::vector<ADIOSVarInfo*>& GetScalars(void) const;
-
-  // Description:
-  // Retrieve a list of arrays and thier associated metadata
-  const std::vector<ADIOSVarInfo*>& GetArrays(void) const;
+  // Retrieve a list of variables.  Their metadata is only inquired from the
+  // file the first time it's accessed, unless it was broadcast on open.
+  const std::vector<ADIOSVarInfo*>& GetVariables(void) const;
 
   // Description:
   // Schedule array data to be read. Data will be read with ReadArrays.
@@ -76,14 +89,81 @@ public:
   void ScheduleReadArray(int id, T *data, int step, int block=-1);
 
   // Description:
-  // Perform all scheduled array read operations
-  void ReadArrays(void);
+  // Schedule a bounding box of a global array to be read. Data will be read
+  // with ReadArrays.  start and count are in the array's global index space.
+  template<typename T>
+  void ScheduleReadArray(int id, T *data, int step,
+    const std::vector<size_t>& start, const std::vector<size_t>& count);
+
+  // Description:
+  // Perform all scheduled array read operations.  If not blocking, the reads
+  // are performed on a worker thread and WaitForReads must be called before
+  // the data is used or the reader is otherwise used.  Scheduling more reads
+  // first waits for any pending ones.  Reads only run in the background if
+  // SupportsBackgroundReads, otherwise they always block.
+  void ReadArrays(bool blocking = true);
+
+  // Description:
+  // Whether reads can be performed on a worker thread, which requires MPI,
+  // if initialized, to allow calls from multiple threads at once
+  static bool SupportsBackgroundReads(void);
+
+  // Description:
+  // Wait for reads started without blocking to finish
+  void WaitForReads(void);
+
+  // Description:
+  // Whether or not there are reads started without blocking still pending
+  bool HasPendingReads(void) const;
 
   // Description:
   // Whether or not the file / stream is already open
   bool IsOpen(void) const;
 
+  // Description:
+  // Get/Set how ranks are synchronized when the reader is closed: with a
+  // barrier (default), or not at all.  Since the reader is only closed at
+  // finalization, deferred synchronization is equivalent to a barrier.
+  void SetSyncPolicy(ADIOS::SyncPolicy policy);
+  ADIOS::SyncPolicy GetSyncPolicy(void) const;
+
+  // Description:
+  // Retrieve the total time in seconds this process has spent waiting on
+  // other ranks in reader synchronization
+  static double GetSyncWaitTime(void);
+
 protected:
+  // Description:
+  // List all variables and read all attributes from the open file
+  void InquireMetadata(void);
+
+  // Description:
+  // Convert the inquired metadata to and from a flat buffer
+  void SerializeMetadata(std::vector<char>& buf) const;
+  void DeserializeMetadata(const std::vector<char>& buf);
+
+  // Description:
+  // Release all variables and attributes
+  void ClearMetadata(void);
+
+  // Description:
+  // Load the metadata from the sidecar index of a file if it exists and was
+  // saved for the given file size and modification time, returning the
+  // serialized metadata in buf.  Returns false, leaving no metadata behind,
+  // if the index is missing, out of date or unreadable.
+  bool LoadMetadataIndex(const std::string& fileName, uint64_t fileSize,
+    int64_t fileMTime, std::vector<char>& buf);
+
+  // Description:
+  // Save serialized metadata to the sidecar index of a file.  Failure to
+  // write the index, e.g. in a read-only directory, is not an error.
+  static void SaveMetadataIndex(const std::string& fileName,
+    uint64_t fileSize, int64_t fileMTime, const std::vector<char>& buf);
+
+  // Description:
+  // Release the selections of all completed reads
+  void ClearSelections(void);
+
   struct ADIOSReaderImpl;
 
   ADIOSReaderImpl *Impl;
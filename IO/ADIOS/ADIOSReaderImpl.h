@@ -21,6 +21,8 @@
 
 #include <adios_read.h>
 
+#include <vtkMultiThreader.h>
+
 #include "ADIOSReader.h"
 #include "ADIOSVarInfo.h"
 #include "ADIOSAttribute.h"
@@ -28,22 +30,51 @@
 struct ADIOSReader::ADIOSReaderImpl
 {
   ADIOSReaderImpl(void)
-  : File(NULL)
+  : SyncPolicy(ADIOS::SyncPolicy_Barrier), BroadcastMetadata(false),
+    MetadataIndex(false), File(NULL), PendingReads(false), Threader(NULL),
+    ThreadId(-1), ReadError(0)
   { }
 
+  static VTK_THREAD_RETURN_TYPE ReadThread(void *arg)
+  {
+    ADIOSReaderImpl *impl = static_cast<ADIOSReaderImpl*>(
+      static_cast<vtkMultiThreader::ThreadInfo*>(arg)->UserData);
+    impl->ReadError = adios_perform_reads(impl->File, 1);
+    return VTK_THREAD_RETURN_VALUE;
+  }
+
+  // ADIOS uses a duplicate of the communicator it was initialized with since
+  // background reads may use it while the application issues collectives
+  static MPI_Comm UserComm;
   static MPI_Comm Comm;
   static ADIOS_READ_METHOD Method;
+  static double SyncWaitTime;
+
+  ADIOS::SyncPolicy SyncPolicy;
+  bool BroadcastMetadata;
+  bool MetadataIndex;
 
   ADIOS_FILE* File;
 
   std::pair<int, int> StepRange;
   std::vector<ADIOSAttribute*> Attributes;
-  std::vector<ADIOSVarInfo*> Scalars;
-  std::vector<ADIOSVarInfo*> Arrays;
-  std::map<std::string, int> ArrayIds;
+  std::vector<ADIOSVarInfo*> Variables;
+  std::map<std::string, int> VarIds;
+
+  // Selections must outlive the reads scheduled with them
+  std::vector<ADIOS_SELECTION*> Selections;
+  bool PendingReads;
+
+  // Reads started without blocking are performed on a worker thread, which
+  // is the only user of the file until it is joined
+  vtkMultiThreader *Threader;
+  int ThreadId;
+  int ReadError;
 };
 
 static const MPI_Comm INVALID_MPI_COMM = static_cast<MPI_Comm>(NULL);
+MPI_Comm ADIOSReader::ADIOSReaderImpl::UserComm = INVALID_MPI_COMM;
 MPI_Comm ADIOSReader::ADIOSReaderImpl::Comm = INVALID_MPI_COMM;
 ADIOS_READ_METHOD ADIOSReader::ADIOSReaderImpl::Method = ADIOS_READ_METHOD_BP;
+double ADIOSReader::ADIOSReaderImpl::SyncWaitTime = 0.0;
 #endif
@@ -4,6 +4,11 @@
 #include <complex>
 #include <string>
 
+#include <vtkSetGet.h>
+#include <vtkMultiProcessController.h>
+
+#include <algorithm>
+
 #define INSTANTIATE(TN, TA) \
 template<> ADIOS_DATATYPES ADIOSUtilities::TypeNativeToADIOS<TN>::T = TA;
 INSTANTIATE(int8_t, adios_byte)
@@ -105,3 +110,98 @@ size_t ADIOSUtilities::TypeSize(ADIOS_DATATYPES ta)
     return 0;
     }
 }
+
+// Whether a value lies within the range of an integer type.  Integers are
+// compared by sign and magnitude rather than by casting back, which can't
+// tell a negative value from its wrapped unsigned counterpart.
+template<typename TOut, typename TIn>
+static bool InIntegerRange(TIn v)
+{
+  typedef std::numeric_limits<TIn> InLimits;
+  typedef std::numeric_limits<TOut> OutLimits;
+  if(!InLimits::is_integer)
+    {
+    return static_cast<double>(v) >= static_cast<double>(OutLimits::min()) &&
+      static_cast<double>(v) < static_cast<double>(OutLimits::max()) + 1.0;
+    }
+  if(InLimits::is_signed && static_cast<vtkTypeInt64>(v) < 0)
+    {
+    return OutLimits::is_signed && static_cast<vtkTypeInt64>(v) >=
+      static_cast<vtkTypeInt64>(OutLimits::min());
+    }
+  return static_cast<vtkTypeUInt64>(v) <=
+    static_cast<vtkTypeUInt64>(OutLimits::max());
+}
+
+template<typename TIn, typename TOut>
+static bool ConvertTyped(const TIn* in, TOut* out, size_t n)
+{
+  bool exact = true;
+  for(size_t i = 0; i < n; ++i)
+    {
+    if(!std::numeric_limits<TOut>::is_integer)
+      {
+      out[i] = static_cast<TOut>(in[i]);
+      }
+    else if(!InIntegerRange<TOut>(in[i]))
+      {
+      // Out of range floating point values can't even be cast
+      out[i] = TOut();
+      exact = false;
+      }
+    else
+      {
+      out[i] = static_cast<TOut>(in[i]);
+      if(static_cast<TIn>(out[i]) != in[i])
+        {
+        exact = false;
+        }
+      }
+    }
+  return exact;
+}
+
+template<typename TIn>
+static bool ConvertFrom(const TIn* in, void* out, int outType, size_t n)
+{
+  switch(outType)
+    {
+    vtkTemplateMacro(return ConvertTyped(in, static_cast<VTK_TT*>(out), n));
+    }
+  throw std::runtime_error("Unsupported conversion output type");
+}
+
+bool ADIOSUtilities::ConvertValues(const void* in, int inType, void* out,
+  int outType, size_t n)
+{
+  switch(inType)
+    {
+    vtkTemplateMacro(return ConvertFrom(static_cast<const VTK_TT*>(in), out,
+      outType, n));
+    }
+  throw std::runtime_error("Unsupported conversion input type");
+}
+
+//----------------------------------------------------------------------------
+void ADIOSUtilities::PrintSyncReport(vtkMultiProcessController *controller,
+  double waitTime, const std::string& label, std::ostream& os)
+{
+  std::vector<double> waitTimes(controller->GetNumberOfProcesses());
+  controller->Gather(&waitTime, &waitTimes[0], 1, 0);
+  if(controller->GetLocalProcessId() != 0)
+    {
+    return;
+    }
+
+  double tMin = waitTimes[0], tMax = waitTimes[0], tSum = 0.0;
+  os << "ADIOS " << label << " wait times:" << std::endl;
+  for(size_t i = 0; i < waitTimes.size(); ++i)
+    {
+    os << "  Rank " << i << ": " << waitTimes[i] << "s" << std::endl;
+    tMin = std::min(tMin, waitTimes[i]);
+    tMax = std::max(tMax, waitTimes[i]);
+    tSum += waitTimes[i];
+    }
+  os << "  Min: " << tMin << "s Max: " << tMax << "s Mean: "
+     << tSum / waitTimes.size() << "s" << std::endl;
+}
@@ -2,14 +2,18 @@
 #define __ADIOSUtilities_h
 
 #include <stdint.h>
+#include <cstring>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <vtkType.h>
 #include <adios.h>
 #include <adios_read.h>
 
+class vtkMultiProcessController;
 
 class ADIOSUtilities
 {
@@ -52,8 +56,82 @@ public:
   // Map type sizes
   static size_t TypeSize(ADIOS_DATATYPES ta);
 
+  // Description:
+  // Convert n values between VTK datatypes.  Returns false if any integer
+  // value could not be represented exactly in the output type.
+  static bool ConvertValues(const void* in, int inType, void* out,
+    int outType, size_t n);
+
+  // Description:
+  // Gather the time each rank has spent waiting in synchronization and print
+  // a per-rank report, titled "ADIOS <label> wait times", on rank 0.  This
+  // must be called on all ranks.
+  static void PrintSyncReport(vtkMultiProcessController *controller,
+    double waitTime, const std::string& label, std::ostream& os);
+
   static const int64_t ADIOS_INVALID_INT64;
 
+  // Description:
+  // Append the binary representation of a value to a buffer
+  template<typename T>
+  static inline void Pack(std::vector<char>& buf, const T& value)
+  {
+    const char *p = reinterpret_cast<const char*>(&value);
+    buf.insert(buf.end(), p, p+sizeof(T));
+  }
+
+  template<typename T>
+  static inline void Pack(std::vector<char>& buf, const std::vector<T>& values)
+  {
+    Pack<uint64_t>(buf, values.size());
+    if(!values.empty())
+      {
+      const char *p = reinterpret_cast<const char*>(&values[0]);
+      buf.insert(buf.end(), p, p+sizeof(T)*values.size());
+      }
+  }
+
+  static inline void Pack(std::vector<char>& buf, const std::string& value)
+  {
+    Pack<uint64_t>(buf, value.size());
+    buf.insert(buf.end(), value.begin(), value.end());
+  }
+
+  // Description:
+  // Extract a value previously packed into a buffer, advancing pos
+  template<typename T>
+  static inline void Unpack(const char*& pos, const char* end, T& value)
+  {
+    TestUnpack(pos, end, sizeof(T));
+    std::memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+  }
+
+  template<typename T>
+  static inline void Unpack(const char*& pos, const char* end,
+    std::vector<T>& values)
+  {
+    uint64_t n;
+    Unpack(pos, end, n);
+    TestUnpack(pos, end, n, sizeof(T));
+    values.resize(n);
+    if(n)
+      {
+      std::memcpy(&values[0], pos, sizeof(T)*n);
+      }
+    pos += sizeof(T)*n;
+  }
+
+  static inline void Unpack(const char*& pos, const char* end,
+    std::string& value)
+  {
+    uint64_t n;
+    Unpack(pos, end, n);
+    TestUnpack(pos, end, n);
+    value.assign(pos, n);
+    pos += n;
+  }
+
   // Definition
   // Test error codes for expected value
   template<typename T>
@@ -97,6 +175,18 @@ public:
       throw std::runtime_error(adios_get_last_errmsg());
       }
   }
+
+private:
+  static inline void TestUnpack(const char* pos, const char* end,
+    uint64_t count, uint64_t size = 1)
+  {
+    // Compare counts rather than sizes so that a corrupt count can't
+    // overflow
+    if(static_cast<uint64_t>(end - pos) / size < count)
+      {
+      throw std::runtime_error("Truncated metadata buffer");
+      }
+  }
 };
 
 #endif
@@ -7,26 +7,276 @@
 //----------------------------------------------------------------------------
 struct ADIOSVarInfo::ADIOSVarInfoImpl
 {
-  ADIOSVarInfoImpl(const std::string& name = "", ADIOS_VARINFO *var = NULL)
-  : Name(name), Var(var)
+  ADIOSVarInfoImpl(const std::string& name = "", ADIOS_FILE *file = NULL,
+    int id = -1)
+  : Name(name), File(file), Loaded(!file), RangesLoaded(!file), Id(id),
+    Type(adios_unknown), NumSteps(0), Global(false)
   { }
 
-  ~ADIOSVarInfoImpl(void)
+  // Description:
+  // Copy the relevant metadata out of an ADIOS varinfo struct
+  void Load(const ADIOS_VARINFO *v);
+
+  // Description:
+  // Inquire the variable from the file if that hasn't happened yet
+  const ADIOSVarInfoImpl* Get(void);
+
+  // Description:
+  // Inquire the variable's min/max characteristics from the file if that
+  // hasn't happened yet.  They're kept out of the rest of the metadata
+  // since they're large and only needed for the arrays readers cull by.
+  const ADIOSVarInfoImpl* GetRanges(void);
+
+  // Description:
+  // Number of scalar values available, one per step when known
+  size_t GetNumValues(void) const
   {
-    if(this->Var)
-      {
-      adios_free_varinfo(this->Var);
-      }
+    size_t size = ADIOSUtilities::TypeSize(this->Type);
+    return size ? this->Values.size() / size : 0;
   }
 
   std::string Name;
-  ADIOS_VARINFO *Var;
+  ADIOS_FILE *File;
+  bool Loaded;
+  bool RangesLoaded;
+  int Id;
+  ADIOS_DATATYPES Type;
+  int NumSteps;
+  bool Global;
+  std::vector<uint64_t> Dims;
+
+  // Block info is stored contiguously for all steps, NumBlocks per step
+  std::vector<int> NumBlocks;
+  std::vector<uint64_t> BlockCounts;
+
+  // Description:
+  // Index of a block in the contiguous per-block storage
+  size_t GetBlockIndex(int step, int block) const;
+
+  // Raw scalar values, per step and per block for all steps
+  std::vector<char> Values;
+  std::vector<char> BlockValues;
+
+  // Min/max characteristics as min, max pairs, per step and per block for
+  // all steps
+  std::vector<double> StepRanges;
+  std::vector<double> BlockRanges;
+
+  // Description:
+  // Copy min/max characteristics into ranges, leaving them empty if any
+  // are missing
+  void LoadRanges(void **mins, void **maxs, int n,
+    std::vector<double>& ranges);
 };
 
+//----------------------------------------------------------------------------
+void ADIOSVarInfo::ADIOSVarInfoImpl::LoadRanges(void **mins, void **maxs,
+  int n, std::vector<double>& ranges)
+{
+  int vtkType = ADIOSUtilities::TypeADIOSToVTK(this->Type);
+  if(!mins || !maxs || vtkType == -1 || vtkType == VTK_STRING)
+    {
+    return;
+    }
+
+  ranges.resize(2*n);
+  for(int i = 0; i < n; ++i)
+    {
+    if(!mins[i] || !maxs[i])
+      {
+      ranges.clear();
+      return;
+      }
+    ADIOSUtilities::ConvertValues(mins[i], vtkType, &ranges[2*i],
+      VTK_DOUBLE, 1);
+    ADIOSUtilities::ConvertValues(maxs[i], vtkType, &ranges[2*i+1],
+      VTK_DOUBLE, 1);
+    }
+}
+
+//----------------------------------------------------------------------------
+size_t ADIOSVarInfo::ADIOSVarInfoImpl::GetBlockIndex(int step,
+  int block) const
+{
+  if(step < 0 || step >= static_cast<int>(this->NumBlocks.size()))
+    {
+    throw std::runtime_error("Step index out of range");
+    }
+  if(block < 0 || block >= this->NumBlocks[step])
+    {
+    throw std::runtime_error("Block index out of range");
+    }
+
+  size_t blockIdx = block;
+  for(int s = 0; s < step; ++s)
+    {
+    blockIdx += this->NumBlocks[s];
+    }
+  return blockIdx;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSVarInfo::ADIOSVarInfoImpl::Load(const ADIOS_VARINFO *v)
+{
+  this->Id = v->varid;
+  this->Type = v->type;
+  this->NumSteps = v->nsteps;
+  this->Global = v->global == 1;
+  this->Dims.assign(v->dims, v->dims+v->ndim);
+
+  if(v->nblocks)
+    {
+    this->NumBlocks.assign(v->nblocks, v->nblocks+v->nsteps);
+    }
+  if(v->blockinfo)
+    {
+    this->BlockCounts.reserve(v->sum_nblocks*v->ndim);
+    for(int b = 0; b < v->sum_nblocks; ++b)
+      {
+      this->BlockCounts.insert(this->BlockCounts.end(),
+        v->blockinfo[b].count, v->blockinfo[b].count+v->ndim);
+      }
+    }
+
+  if(v->ndim != 0 || !v->value)
+    {
+    return;
+    }
+
+  // Scalars carry one value per step in their statistics if those have been
+  // inquired, otherwise only the value of the current step is available
+  const char *value = reinterpret_cast<const char*>(v->value);
+  if(this->Type == adios_string)
+    {
+    this->Values.assign(value, value+std::strlen(value)+1);
+    }
+  else if(v->statistics && v->statistics->steps &&
+    v->statistics->steps->mins)
+    {
+    size_t size = ADIOSUtilities::TypeSize(this->Type);
+    for(int s = 0; s < v->nsteps; ++s)
+      {
+      const char *sv = reinterpret_cast<const char*>(
+        v->statistics->steps->mins[s]);
+      this->Values.insert(this->Values.end(), sv ? sv : value,
+        (sv ? sv : value)+size);
+      }
+    }
+  else
+    {
+    this->Values.assign(value,
+      value+ADIOSUtilities::TypeSize(this->Type));
+    }
+
+  // Scalars written by every process have a distinct value for each block
+  if(this->Type != adios_string && v->statistics &&
+    v->statistics->blocks && v->statistics->blocks->mins)
+    {
+    size_t size = ADIOSUtilities::TypeSize(this->Type);
+    this->BlockValues.reserve(v->sum_nblocks*size);
+    for(int b = 0; b < v->sum_nblocks; ++b)
+      {
+      const char *bv = reinterpret_cast<const char*>(
+        v->statistics->blocks->mins[b]);
+      if(!bv)
+        {
+        this->BlockValues.clear();
+        break;
+        }
+      this->BlockValues.insert(this->BlockValues.end(), bv, bv+size);
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+const ADIOSVarInfo::ADIOSVarInfoImpl* ADIOSVarInfo::ADIOSVarInfoImpl::Get(void)
+{
+  if(this->Loaded)
+    {
+    return this;
+    }
+
+  int err;
+  ADIOS_VARINFO *v = adios_inq_var_byid(this->File, this->Id);
+  ADIOSUtilities::TestReadErrorNe<void*>(NULL, v);
+
+  if(v->ndim == 0)
+    {
+    // Per-step and per-block statistics hold the scalar's value for every
+    // step and every writing process
+    if(v->type != adios_string)
+      {
+      adios_inq_var_stat(this->File, v, 1, 1);
+      }
+    }
+  else
+    {
+    // Array sizes may vary by step and block so retrieve the per-block
+    // dimensions as well
+    err = adios_inq_var_blockinfo(this->File, v);
+    if(err != 0)
+      {
+      adios_free_varinfo(v);
+      ADIOSUtilities::TestReadErrorEq(0, err);
+      }
+    }
+
+  this->Load(v);
+  adios_free_varinfo(v);
+  this->Loaded = true;
+  return this;
+}
+
+//----------------------------------------------------------------------------
+const ADIOSVarInfo::ADIOSVarInfoImpl*
+ADIOSVarInfo::ADIOSVarInfoImpl::GetRanges(void)
+{
+  this->Get();
+  if(this->RangesLoaded)
+    {
+    return this;
+    }
+  this->RangesLoaded = true;
+  if(this->Type == adios_string)
+    {
+    return this;
+    }
+
+  ADIOS_VARINFO *v = adios_inq_var_byid(this->File, this->Id);
+  ADIOSUtilities::TestReadErrorNe<void*>(NULL, v);
+  if(adios_inq_var_stat(this->File, v, 1, 1) == 0 && v->statistics)
+    {
+    if(v->statistics->steps)
+      {
+      this->LoadRanges(v->statistics->steps->mins,
+        v->statistics->steps->maxs, v->nsteps, this->StepRanges);
+      }
+    if(v->statistics->blocks)
+      {
+      this->LoadRanges(v->statistics->blocks->mins,
+        v->statistics->blocks->maxs, v->sum_nblocks, this->BlockRanges);
+      }
+    }
+  adios_free_varinfo(v);
+  return this;
+}
+
 //----------------------------------------------------------------------------
 ADIOSVarInfo::ADIOSVarInfo(const std::string& name, void* v)
+: Impl(new ADIOSVarInfo::ADIOSVarInfoImpl(name))
+{
+  if(v)
+    {
+    ADIOS_VARINFO *var = reinterpret_cast<ADIOS_VARINFO*>(v);
+    this->Impl->Load(var);
+    adios_free_varinfo(var);
+    }
+}
+
+//----------------------------------------------------------------------------
+ADIOSVarInfo::ADIOSVarInfo(const std::string& name, void* file, int id)
 : Impl(new ADIOSVarInfo::ADIOSVarInfoImpl(name,
-    reinterpret_cast<ADIOS_VARINFO*>(v)))
+    reinterpret_cast<ADIOS_FILE*>(file), id))
 {
 }
 
@@ -45,60 +295,214 @@ std::string ADIOSVarInfo::GetName(void) const
 //----------------------------------------------------------------------------
 int ADIOSVarInfo::GetId(void) const
 {
-  return this->Impl->Var->varid;
+  return this->Impl->Id;
 }
 
 //----------------------------------------------------------------------------
 int ADIOSVarInfo::GetType(void) const
 {
-  return ADIOSUtilities::TypeADIOSToVTK(this->Impl->Var->type);
+  return ADIOSUtilities::TypeADIOSToVTK(this->Impl->Get()->Type);
 }
 
 //----------------------------------------------------------------------------
 size_t ADIOSVarInfo::GetNumSteps(void) const
 {
-  return this->Impl->Var->nsteps;
+  return this->Impl->Get()->NumSteps;
 }
 
 //----------------------------------------------------------------------------
 bool ADIOSVarInfo::IsGlobal(void) const
 {
-  return this->Impl->Var->global == 1;
+  return this->Impl->Get()->Global;
 }
 
 //----------------------------------------------------------------------------
 bool ADIOSVarInfo::IsScalar(void) const
 {
-  return this->Impl->Var->ndim == 0;
+  return this->Impl->Get()->Dims.empty();
 }
 
 //----------------------------------------------------------------------------
 void ADIOSVarInfo::GetDims(std::vector<size_t>& dims) const
 {
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  dims.clear();
+  dims.insert(dims.begin(), v->Dims.begin(), v->Dims.end());
+}
+
+//----------------------------------------------------------------------------
+void ADIOSVarInfo::GetDims(std::vector<size_t>& dims, int step,
+  int block) const
+{
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  if(v->BlockCounts.empty() || v->NumBlocks.empty() || step < 0 ||
+    step >= v->NumSteps)
+    {
+    this->GetDims(dims);
+    return;
+    }
+
+  // Block info is stored contiguously for all steps
+  std::vector<uint64_t>::const_iterator b =
+    v->BlockCounts.begin() + v->GetBlockIndex(step, block)*v->Dims.size();
   dims.clear();
-  dims.insert(dims.begin(), this->Impl->Var->dims,
-    this->Impl->Var->dims+this->Impl->Var->ndim);
+  dims.insert(dims.begin(), b, b+v->Dims.size());
+}
+
+//----------------------------------------------------------------------------
+size_t ADIOSVarInfo::GetNumBlocks(int step) const
+{
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  if(step < 0 || step >= static_cast<int>(v->NumBlocks.size()))
+    {
+    return 0;
+    }
+  return v->NumBlocks[step];
+}
+
+//----------------------------------------------------------------------------
+size_t ADIOSVarInfo::GetBlockSize(int step, int block) const
+{
+  std::vector<size_t> dims;
+  this->GetDims(dims, step, block);
+
+  size_t size = ADIOSUtilities::TypeSize(this->Impl->Get()->Type);
+  for(size_t i = 0; i < dims.size(); ++i)
+    {
+    size *= dims[i];
+    }
+  return size;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSVarInfo::Serialize(std::vector<char>& buf) const
+{
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  ADIOSUtilities::Pack(buf, v->Name);
+  ADIOSUtilities::Pack<int32_t>(buf, v->Id);
+  ADIOSUtilities::Pack<int32_t>(buf, v->Type);
+  ADIOSUtilities::Pack<int32_t>(buf, v->NumSteps);
+  ADIOSUtilities::Pack<uint8_t>(buf, v->Global);
+  ADIOSUtilities::Pack(buf, v->Dims);
+  ADIOSUtilities::Pack(buf, v->NumBlocks);
+  ADIOSUtilities::Pack(buf, v->BlockCounts);
+  ADIOSUtilities::Pack(buf, v->Values);
+  ADIOSUtilities::Pack(buf, v->BlockValues);
+}
+
+//----------------------------------------------------------------------------
+ADIOSVarInfo* ADIOSVarInfo::Deserialize(const char*& pos, const char* end,
+  void* file)
+{
+  ADIOSVarInfo *info = new ADIOSVarInfo;
+  ADIOSVarInfoImpl *v = info->Impl;
+  v->File = reinterpret_cast<ADIOS_FILE*>(file);
+  v->RangesLoaded = !file;
+  try
+    {
+    int32_t id, type, numSteps;
+    uint8_t global;
+    ADIOSUtilities::Unpack(pos, end, v->Name);
+    ADIOSUtilities::Unpack(pos, end, id);
+    ADIOSUtilities::Unpack(pos, end, type);
+    ADIOSUtilities::Unpack(pos, end, numSteps);
+    ADIOSUtilities::Unpack(pos, end, global);
+    ADIOSUtilities::Unpack(pos, end, v->Dims);
+    ADIOSUtilities::Unpack(pos, end, v->NumBlocks);
+    ADIOSUtilities::Unpack(pos, end, v->BlockCounts);
+    ADIOSUtilities::Unpack(pos, end, v->Values);
+    ADIOSUtilities::Unpack(pos, end, v->BlockValues);
+    v->Id = id;
+    v->Type = static_cast<ADIOS_DATATYPES>(type);
+    v->NumSteps = numSteps;
+    v->Global = global != 0;
+    }
+  catch(...)
+    {
+    delete info;
+    throw;
+    }
+  return info;
+}
+
+//----------------------------------------------------------------------------
+bool ADIOSVarInfo::GetRange(int step, double range[2]) const
+{
+  const ADIOSVarInfoImpl *v = this->Impl->GetRanges();
+  if(step < 0 || static_cast<size_t>(step) >= v->StepRanges.size()/2)
+    {
+    return false;
+    }
+  range[0] = v->StepRanges[2*step];
+  range[1] = v->StepRanges[2*step+1];
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool ADIOSVarInfo::GetRange(int step, int block, double range[2]) const
+{
+  const ADIOSVarInfoImpl *v = this->Impl->GetRanges();
+  if(v->BlockRanges.empty() || step < 0 ||
+    step >= static_cast<int>(v->NumBlocks.size()) || block < 0 ||
+    block >= v->NumBlocks[step])
+    {
+    return false;
+    }
+  size_t b = v->GetBlockIndex(step, block);
+  if(b >= v->BlockRanges.size()/2)
+    {
+    return false;
+    }
+  range[0] = v->BlockRanges[2*b];
+  range[1] = v->BlockRanges[2*b+1];
+  return true;
 }
 
 //----------------------------------------------------------------------------
 template<typename T>
 T ADIOSVarInfo::GetValue(int step) const
 {
-  if(ADIOSUtilities::TypeNativeToADIOS<T>::T != this->Impl->Var->type)
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  if(ADIOSUtilities::TypeNativeToADIOS<T>::T != v->Type)
+    {
+    throw std::runtime_error("Incompatible type");
+    }
+  if(step < 0 || static_cast<size_t>(step) >= v->GetNumValues())
+    {
+    throw std::runtime_error("Value not available for step");
+    }
+  return reinterpret_cast<const T*>(&v->Values[0])[step];
+}
+
+template<typename T>
+T ADIOSVarInfo::GetValue(int step, int block) const
+{
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  if(v->BlockValues.empty())
+    {
+    return this->GetValue<T>(step);
+    }
+  if(ADIOSUtilities::TypeNativeToADIOS<T>::T != v->Type)
     {
     throw std::runtime_error("Incompatible type");
     }
-  return reinterpret_cast<const T*>(this->Impl->Var->value)[step];
+  return reinterpret_cast<const T*>(&v->BlockValues[0])[
+    v->GetBlockIndex(step, block)];
 }
 
 template<>
 std::string ADIOSVarInfo::GetValue<std::string>(int step) const
 {
-  if(this->Impl->Var->type != ADIOSUtilities::TypeNativeToADIOS<std::string>::T)
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  if(v->Type != ADIOSUtilities::TypeNativeToADIOS<std::string>::T)
     {
     throw std::runtime_error("Incompatible type");
     }
-  return reinterpret_cast<const char**>(this->Impl->Var->value)[step];
+  if(step != 0 || v->Values.empty())
+    {
+    throw std::runtime_error("Value not available for step");
+    }
+  return &v->Values[0];
 }
 
 template int8_t ADIOSVarInfo::GetValue<int8_t>(int) const;
@@ -113,15 +517,32 @@ template vtkIdType ADIOSVarInfo::GetValue<vtkIdType>(int) const;
 template float ADIOSVarInfo::GetValue<float>(int) const;
 template double ADIOSVarInfo::GetValue<double>(int) const;
 
+template int8_t ADIOSVarInfo::GetValue<int8_t>(int, int) const;
+template int16_t ADIOSVarInfo::GetValue<int16_t>(int, int) const;
+template int32_t ADIOSVarInfo::GetValue<int32_t>(int, int) const;
+template int64_t ADIOSVarInfo::GetValue<int64_t>(int, int) const;
+template uint8_t ADIOSVarInfo::GetValue<uint8_t>(int, int) const;
+template uint16_t ADIOSVarInfo::GetValue<uint16_t>(int, int) const;
+template uint32_t ADIOSVarInfo::GetValue<uint32_t>(int, int) const;
+template uint64_t ADIOSVarInfo::GetValue<uint64_t>(int, int) const;
+template vtkIdType ADIOSVarInfo::GetValue<vtkIdType>(int, int) const;
+template float ADIOSVarInfo::GetValue<float>(int, int) const;
+template double ADIOSVarInfo::GetValue<double>(int, int) const;
+
 //----------------------------------------------------------------------------
 template<typename T>
 const T* ADIOSVarInfo::GetAllValues(void) const
 {
-  if(ADIOSUtilities::TypeNativeToADIOS<T>::T != this->Impl->Var->type)
+  const ADIOSVarInfoImpl *v = this->Impl->Get();
+  if(ADIOSUtilities::TypeNativeToADIOS<T>::T != v->Type)
     {
     throw std::runtime_error("Incompatible type");
     }
-  return reinterpret_cast<const T*>(this->Impl->Var->value);
+  if(v->GetNumValues() < static_cast<size_t>(v->NumSteps))
+    {
+    throw std::runtime_error("Values not available for all steps");
+    }
+  return reinterpret_cast<const T*>(&v->Values[0]);
 }
 
 template const int8_t* ADIOSVarInfo::GetAllValues<int8_t>(void) const;
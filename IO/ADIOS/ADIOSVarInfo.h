@@ -13,6 +13,11 @@
 
 =========================================================================*/
 // .NAME ADIOSVarInfo - The utility class wrapping the ADIOS_VARINFO struct
+// .SECTION Description
+// The relevant contents of the ADIOS_VARINFO struct are copied out of ADIOS
+// so that variable metadata can be serialized and shared between processes
+// without each of them inquiring the file.  A variable constructed from an
+// open file and id is only inquired the first time its metadata is needed.
 
 #ifndef _ADIOSVarInfo_h
 #define _ADIOSVarInfo_h
@@ -25,6 +30,11 @@ class ADIOSVarInfo
 {
 public:
   ADIOSVarInfo(const std::string &name = "", void* var = NULL);
+
+  // Description:
+  // Construct a variable whose metadata is inquired from the given
+  // ADIOS_FILE on first access.  The file must outlive the variable.
+  ADIOSVarInfo(const std::string &name, void* file, int id);
   ~ADIOSVarInfo(void);
 
   std::string GetName(void) const;
@@ -35,12 +45,53 @@ public:
   bool IsScalar(void) const;
   void GetDims(std::vector<size_t>& dims) const;
 
+  // Description:
+  // Retrieve the dimensions of a specific written block for a given step.
+  // Falls back to the global dims if no block info is available.
+  void GetDims(std::vector<size_t>& dims, int step, int block) const;
+
+  // Description:
+  // Retrieve the number of blocks written for a given step
+  size_t GetNumBlocks(int step) const;
+
+  // Description:
+  // Retrieve the size in bytes of a specific written block for a given step
+  size_t GetBlockSize(int step, int block) const;
+
   template<typename T>
   T GetValue(int step = 0) const;
 
+  // Description:
+  // Retrieve the value a specific block wrote for a scalar written by every
+  // process.  Falls back to the value for the step if per-block values are
+  // not available.
+  template<typename T>
+  T GetValue(int step, int block) const;
+
   template<typename T>
   const T* GetAllValues(void) const;
 
+  // Description:
+  // Retrieve the range of values written for a given step, or by a specific
+  // block for a given step, from the min/max characteristics ADIOS records
+  // on write.  They are inquired from the file on first use and are not
+  // part of the serialized metadata.  Ranges span all components of an
+  // array.  Returns false if no statistics are available for the variable,
+  // e.g. for strings.
+  bool GetRange(int step, double range[2]) const;
+  bool GetRange(int step, int block, double range[2]) const;
+
+  // Description:
+  // Append a binary representation of the variable's metadata to a buffer
+  void Serialize(std::vector<char>& buf) const;
+
+  // Description:
+  // Reconstruct a variable previously serialized into a buffer, advancing
+  // pos past it.  If given, the open ADIOS_FILE it was serialized from is
+  // used to inquire its statistics on demand.
+  static ADIOSVarInfo* Deserialize(const char*& pos, const char* end,
+    void* file = NULL);
+
 private:
   struct ADIOSVarInfoImpl;
   ADIOSVarInfoImpl *Impl;
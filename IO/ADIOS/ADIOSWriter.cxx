@@ -15,11 +15,17 @@
 
 #include <limits>
 #include <complex>
+#include <deque>
+#include <map>
 #include <sstream>
 #include <fstream>
 #include <iostream>
 #include <adios.h>
 
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkConditionVariable.h>
+
 #include "ADIOSWriter.h"
 #include "ADIOSUtilities.h"
 
@@ -38,13 +44,53 @@ extern "C" {
 
 static const int64_t INVALID_INT64 = std::numeric_limits<int64_t>::min();
 static const MPI_Comm INVALID_MPI_COMM = static_cast<MPI_Comm>(NULL);
+static const uint64_t MB = 1024*1024;
 
 //----------------------------------------------------------------------------
 struct ADIOSWriter::ADIOSWriterImpl
 {
+  // Description:
+  // Per array metadata recorded at definition time.  The ADIOS ids of the
+  // array and its dimension scalars are kept so that writes need no lookup
+  // by name.
+  struct ArrayInfo
+  {
+    std::string Path;
+    int64_t Id;
+    std::vector<int64_t> DimIds;
+    std::vector<int64_t> GlobalDimIds;
+    std::vector<int64_t> OffsetIds;
+    size_t TypeSize;
+  };
+
+  // Description:
+  // A write scheduled for the current step.  Scalars, and arrays when
+  // writing asynchronously, are copied into Copy while arrays otherwise
+  // reference the caller's memory.
+  struct PendingWrite
+  {
+    int64_t Id;
+    const void *Data;
+    std::string Copy;
+    uint64_t Size;
+  };
+
+  // Description:
+  // Everything needed to commit a single step to disk
+  struct Step
+  {
+    std::string FileName;
+    bool Append;
+    uint64_t GroupSize;
+    std::vector<PendingWrite> Writes;
+  };
+
   ADIOSWriterImpl(void)
-  : IsWriting(false), File(INVALID_INT64), Group(INVALID_INT64),
-    GroupSize(0), TotalSize(0)
+  : IsWriting(false), IsOpen(false), Append(false), File(INVALID_INT64),
+    Group(INVALID_INT64), GroupSize(0), TotalSize(0), BufferHeadroom(1.25),
+    NumberOfBufferOverflows(0), SyncPolicy(ADIOS::SyncPolicy_Barrier),
+    NeedsSync(false), QueueDepth(0), Threader(NULL), ThreadId(-1),
+    StopThread(false)
   {
   }
 
@@ -57,14 +103,418 @@ struct ADIOSWriter::ADIOSWriterImpl
       }
   }
 
+  void TestOpen(void)
+  {
+    if(!this->IsOpen)
+      {
+      throw std::runtime_error("Unable to write without an open file");
+      }
+  }
+
+  // Description:
+  // Make sure the ADIOS buffer is large enough to hold a step of the given
+  // size without flushing mid-step.  The buffer is only ever grown.
+  void ResizeBuffer(uint64_t groupSize)
+  {
+    // Account for the ADIOS overhead measured on the previous step
+    uint64_t required = static_cast<uint64_t>(
+      groupSize * this->BufferHeadroom);
+    if(this->TotalSize > required)
+      {
+      required = this->TotalSize;
+      }
+    uint64_t requiredMB = (required + MB - 1) / MB;
+    if(requiredMB == 0)
+      {
+      requiredMB = 1;
+      }
+
+    if(requiredMB > BufferSizeMB)
+      {
+      DebugMacro("Resize buffer: " << BufferSizeMB << "MB -> " <<
+        requiredMB << "MB");
+      int err = adios_allocate_buffer(ADIOS_BUFFER_ALLOC_NOW, requiredMB);
+      ADIOSUtilities::TestWriteErrorEq(0, err);
+      this->Lock.Lock();
+      BufferSizeMB = requiredMB;
+      this->Lock.Unlock();
+      }
+  }
+
+  // Description:
+  // Define a variable and record its ADIOS id under its name
+  int64_t DefineVar(const std::string& path, ADIOS_DATATYPES type)
+  {
+    int64_t id;
+    id = adios_define_var(this->Group, path.c_str(), "", type, NULL, NULL,
+      NULL);
+    ADIOSUtilities::TestWriteErrorNe<int64_t>(-1, id);
+    this->Scalars[path] = id;
+    return id;
+  }
+
+  int64_t GetScalarId(const std::string& path) const
+  {
+    std::map<std::string, int64_t>::const_iterator s =
+      this->Scalars.find(path);
+    if(s == this->Scalars.end())
+      {
+      throw std::runtime_error("Scalar " + path + " has not been defined");
+      }
+    return s->second;
+  }
+
+  void ScheduleScalar(int64_t id, const void *value, size_t size)
+  {
+    this->Pending.push_back(PendingWrite());
+    PendingWrite &w = this->Pending.back();
+    w.Id = id;
+    w.Data = NULL;
+    w.Copy.assign(reinterpret_cast<const char*>(value), size);
+    w.Size = size;
+    this->GroupSize += size;
+  }
+
+  // Description:
+  // Define one scalar per dimension named <path>_<suffix><i> and return the
+  // ADIOS dimension string referencing them
+  std::string DefineDims(const std::string& path, const char *suffix,
+    size_t numDims, std::vector<int64_t>& ids)
+  {
+    ids.clear();
+    std::stringstream ssDims;
+    for(size_t i = 0; i < numDims; ++i)
+      {
+      std::stringstream ssName;
+      ssName << path << '_' << suffix << i;
+      ids.push_back(this->DefineVar(ssName.str(), adios_unsigned_long));
+
+      ssDims << (i == 0 ? "" : ",") << ssName.str();
+      }
+    return ssDims.str();
+  }
+
+  // Description:
+  // Get the record for an array, creating a new one if it's being redefined
+  ArrayInfo& GetArrayInfo(const std::string& path)
+  {
+    std::map<std::string, int>::const_iterator a = this->ArrayIds.find(path);
+    if(a != this->ArrayIds.end())
+      {
+      return this->Arrays[a->second];
+      }
+    this->ArrayIds[path] = static_cast<int>(this->Arrays.size());
+    this->Arrays.push_back(ArrayInfo());
+    this->Arrays.back().Path = path;
+    return this->Arrays.back();
+  }
+
+  int GetArrayHandle(const std::string& path) const
+  {
+    std::map<std::string, int>::const_iterator a = this->ArrayIds.find(path);
+    return a != this->ArrayIds.end() ? a->second : -1;
+  }
+
+  void ScheduleDims(const std::vector<int64_t>& ids,
+    const std::vector<size_t>& dims)
+  {
+    for(size_t i = 0; i < dims.size(); ++i)
+      {
+      uint64_t d = dims[i];
+      this->ScheduleScalar(ids[i], &d, sizeof(d));
+      }
+  }
+
+  void ScheduleArray(const std::string& path, const void *value,
+    const std::vector<size_t>& dims, const std::vector<size_t>& globalDims,
+    const std::vector<size_t>& offsets)
+  {
+    int handle = this->GetArrayHandle(path);
+    if(handle < 0)
+      {
+      this->TestOpen();
+      throw std::runtime_error("Array " + path + " has not been defined");
+      }
+    this->ScheduleArray(handle, value, dims, globalDims, offsets);
+  }
+
+  void ScheduleArray(int handle, const void *value,
+    const std::vector<size_t>& dims, const std::vector<size_t>& globalDims,
+    const std::vector<size_t>& offsets)
+  {
+    this->TestOpen();
+    if(handle < 0 || static_cast<size_t>(handle) >= this->Arrays.size())
+      {
+      throw std::runtime_error("Invalid array handle");
+      }
+    const ArrayInfo &info = this->Arrays[handle];
+    if(info.DimIds.size() != dims.size() ||
+       info.GlobalDimIds.size() != globalDims.size() ||
+       info.OffsetIds.size() != offsets.size())
+      {
+      throw std::runtime_error("Array " + info.Path +
+        " written with the wrong number of dimensions");
+      }
+
+    this->IsWriting = true;
+
+    // Write the current dimensions before the data that uses them
+    this->ScheduleDims(info.DimIds, dims);
+    this->ScheduleDims(info.GlobalDimIds, globalDims);
+    this->ScheduleDims(info.OffsetIds, offsets);
+
+    uint64_t numBytes = info.TypeSize;
+    for(size_t i = 0; i < dims.size(); ++i)
+      {
+      numBytes *= dims[i];
+      }
+
+    this->Pending.push_back(PendingWrite());
+    PendingWrite &w = this->Pending.back();
+    w.Id = info.Id;
+    w.Size = numBytes;
+    if(this->QueueDepth > 0)
+      {
+      // The step will be written after the caller has moved on so the data
+      // must be snapshotted now
+      w.Data = NULL;
+      w.Copy.assign(reinterpret_cast<const char*>(value), numBytes);
+      }
+    else
+      {
+      w.Data = value;
+      }
+    this->GroupSize += numBytes;
+  }
+
+  // Description:
+  // Perform the actual ADIOS open, write and close for a step.  This is
+  // called either directly from Close or from the I/O thread.
+  void CommitStep(const Step &step)
+  {
+    this->ResizeBuffer(step.GroupSize);
+
+    int err;
+    err = adios_open(&this->File, "VTK", step.FileName.c_str(),
+      step.Append ? "a" : "w", Comm);
+    ADIOSUtilities::TestWriteErrorEq(0, err);
+
+    uint64_t totalSize;
+    err = adios_group_size(this->File, step.GroupSize, &totalSize);
+    ADIOSUtilities::TestWriteErrorEq(0, err);
+
+    // If the step still doesn't fit then ADIOS will need to flush part way
+    // through.  The next step's buffer will be sized from this one.
+    this->Lock.Lock();
+    this->TotalSize = totalSize;
+    if(totalSize > BufferSizeMB * MB)
+      {
+      ++this->NumberOfBufferOverflows;
+      }
+    this->Lock.Unlock();
+
+    typedef std::vector<PendingWrite>::const_iterator PendingIt;
+    for(PendingIt w = step.Writes.begin(); w != step.Writes.end(); ++w)
+      {
+      const void *data = w->Data ? w->Data : w->Copy.c_str();
+      err = adios_write_byid(this->File, w->Id, const_cast<void*>(data));
+      ADIOSUtilities::TestWriteErrorEq(0, err);
+      }
+
+    adios_close(this->File);
+    this->File = INVALID_INT64;
+
+    switch(this->SyncPolicy)
+      {
+      case ADIOS::SyncPolicy_Barrier:
+        Barrier();
+        break;
+      case ADIOS::SyncPolicy_Deferred:
+        this->NeedsSync = true;
+        break;
+      default:
+        break;
+      }
+  }
+
+  // Description:
+  // Synchronize all ranks, recording how long this rank waited
+  static void Barrier(void)
+  {
+    double t0 = MPI_Wtime();
+    MPI_Barrier(Comm);
+    double t1 = MPI_Wtime();
+
+    SyncLock.Lock();
+    SyncWaitTime += t1 - t0;
+    SyncLock.Unlock();
+  }
+
+  // Description:
+  // Hand a step off to the I/O thread, blocking while the queue is full
+  void EnqueueStep(Step *step)
+  {
+    this->Lock.Lock();
+    while(this->Queue.size() >= this->QueueDepth && this->Error.empty())
+      {
+      this->QueueChanged.Wait(this->Lock);
+      }
+    if(this->Error.empty())
+      {
+      this->Queue.push_back(step);
+      step = NULL;
+      this->QueueChanged.Broadcast();
+      }
+    this->Lock.Unlock();
+
+    delete step;
+    this->TestAsyncError();
+  }
+
+  // Description:
+  // Block until all queued steps have been committed
+  void WaitForQueue(void)
+  {
+    this->Lock.Lock();
+    while(!this->Queue.empty())
+      {
+      this->QueueChanged.Wait(this->Lock);
+      }
+    this->Lock.Unlock();
+  }
+
+  // Description:
+  // Re-throw on the calling thread any error raised by the I/O thread
+  void TestAsyncError(void)
+  {
+    this->Lock.Lock();
+    std::string err;
+    err.swap(this->Error);
+    this->Lock.Unlock();
+    if(!err.empty())
+      {
+      throw std::runtime_error(err);
+      }
+  }
+
+  static VTK_THREAD_RETURN_TYPE IOThread(void *arg)
+  {
+    ADIOSWriterImpl *impl = static_cast<ADIOSWriterImpl*>(
+      static_cast<vtkMultiThreader::ThreadInfo*>(arg)->UserData);
+
+    impl->Lock.Lock();
+    while(true)
+      {
+      while(impl->Queue.empty() && !impl->StopThread)
+        {
+        impl->QueueChanged.Wait(impl->Lock);
+        }
+      if(impl->Queue.empty())
+        {
+        break;
+        }
+
+      // Leave the step in the queue while it's being written so that
+      // WaitForQueue also waits on the step in flight
+      Step *step = impl->Queue.front();
+      impl->Lock.Unlock();
+
+      std::string err;
+      try
+        {
+        impl->CommitStep(*step);
+        }
+      catch(const std::exception &e)
+        {
+        err = e.what();
+        }
+      catch(...)
+        {
+        err = "Unknown error writing step";
+        }
+      delete step;
+
+      impl->Lock.Lock();
+      impl->Queue.pop_front();
+      if(!err.empty() && impl->Error.empty())
+        {
+        impl->Error = err;
+        }
+      impl->QueueChanged.Broadcast();
+      }
+    impl->Lock.Unlock();
+
+    return VTK_THREAD_RETURN_VALUE;
+  }
+
+  void StartIOThread(void)
+  {
+    if(!this->Threader)
+      {
+      this->Threader = vtkMultiThreader::New();
+      }
+    this->StopThread = false;
+    this->ThreadId = this->Threader->SpawnThread(
+      &ADIOSWriterImpl::IOThread, this);
+  }
+
+  void StopIOThread(void)
+  {
+    if(this->ThreadId == -1)
+      {
+      return;
+      }
+
+    // The thread drains the queue before exiting
+    this->Lock.Lock();
+    this->StopThread = true;
+    this->QueueChanged.Broadcast();
+    this->Lock.Unlock();
+
+    this->Threader->TerminateThread(this->ThreadId);
+    this->ThreadId = -1;
+  }
+
+  // ADIOS and the I/O thread use a duplicate of the communicator they were
+  // initialized with so that they never share it with collectives issued by
+  // the rest of the application at the same time
+  static MPI_Comm UserComm;
   static MPI_Comm Comm;
+  static uint64_t BufferSizeMB;
+  static double SyncWaitTime;
+  static vtkSimpleMutexLock SyncLock;
   bool IsWriting;
+  bool IsOpen;
+  std::string FileName;
+  bool Append;
   int64_t File;
   int64_t Group;
   uint64_t GroupSize;
   uint64_t TotalSize;
+  double BufferHeadroom;
+  size_t NumberOfBufferOverflows;
+  ADIOS::SyncPolicy SyncPolicy;
+  bool NeedsSync;
+  std::map<std::string, int64_t> Scalars;
+  std::map<std::string, int> ArrayIds;
+  std::vector<ArrayInfo> Arrays;
+  std::vector<PendingWrite> Pending;
+
+  // Asynchronous writing
+  size_t QueueDepth;
+  std::deque<Step*> Queue;
+  vtkMultiThreader *Threader;
+  int ThreadId;
+  bool StopThread;
+  std::string Error;
+  vtkSimpleMutexLock Lock;
+  vtkSimpleConditionVariable QueueChanged;
 };
+MPI_Comm ADIOSWriter::ADIOSWriterImpl::UserComm = INVALID_MPI_COMM;
 MPI_Comm ADIOSWriter::ADIOSWriterImpl::Comm = INVALID_MPI_COMM;
+uint64_t ADIOSWriter::ADIOSWriterImpl::BufferSizeMB = 0;
+double ADIOSWriter::ADIOSWriterImpl::SyncWaitTime = 0.0;
+vtkSimpleMutexLock ADIOSWriter::ADIOSWriterImpl::SyncLock;
 
 //----------------------------------------------------------------------------
 ADIOSWriter::ADIOSWriter(ADIOS::TransportMethod transport,
@@ -93,23 +543,33 @@ bool ADIOSWriter::Initialize(MPI_Comm comm)
   if(ADIOSWriterImpl::Comm)
     {
     // Already initialized
-    return ADIOSWriterImpl::Comm == comm;
+    return ADIOSWriterImpl::UserComm == comm;
     }
-  ADIOSWriterImpl::Comm = comm;
+  ADIOSWriterImpl::UserComm = comm;
+  MPI_Comm_dup(comm, &ADIOSWriterImpl::Comm);
 
   int err;
 
   err = adios_init_noxml(ADIOSWriterImpl::Comm);
   ADIOSUtilities::TestWriteErrorEq(0, err);
 
-  err = adios_allocate_buffer(ADIOS_BUFFER_ALLOC_NOW, 100);
-  ADIOSUtilities::TestWriteErrorEq(0, err);
+  // The buffer gets sized from the data of the first step when it's written
+  return true;
 }
 
 //----------------------------------------------------------------------------
 ADIOSWriter::~ADIOSWriter(void)
 {
   this->Close();
+  this->Impl->StopIOThread();
+  if(this->Impl->Threader)
+    {
+    this->Impl->Threader->Delete();
+    }
+  if(this->Impl->NeedsSync)
+    {
+    ADIOSWriterImpl::Barrier();
+    }
   delete this->Impl;
 
   int rank = 0;
@@ -124,7 +584,9 @@ void ADIOSWriter::DefineAttribute(const std::string& path, const TN& value)
   DebugMacro( "Define Attribute: " << path << ": " << value);
 
   // ADIOS attributes are stored as thier "stringified" versions :-(
+  // so floating point values need enough digits to round trip
   std::stringstream valueStr;
+  valueStr.precision(std::numeric_limits<TN>::digits10 + 3);
   valueStr << value;
 
   int err;
@@ -155,11 +617,7 @@ void ADIOSWriter::DefineScalar(const std::string& path)
   DebugMacro( "Define Scalar: " << path);
 
   this->Impl->TestDefine();
-  int id;
-  id = adios_define_var(this->Impl->Group, path.c_str(), "",
-    ADIOSUtilities::TypeNativeToADIOS<TN>::T, NULL, NULL, NULL);
-  ADIOSUtilities::TestWriteErrorNe(-1, id);
-  this->Impl->GroupSize += sizeof(TN);
+  this->Impl->DefineVar(path, ADIOSUtilities::TypeNativeToADIOS<TN>::T);
 }
 #define INSTANTIATE(T) \
 template void ADIOSWriter::DefineScalar<T>(const std::string& path);
@@ -177,28 +635,34 @@ INSTANTIATE(double)
 #undef INSTANTIATE
 
 //----------------------------------------------------------------------------
-void ADIOSWriter::DefineScalar(const std::string& path, const std::string& v)
+void ADIOSWriter::DefineScalar(const std::string& path, const std::string&)
 {
   DebugMacro( "Define Scalar: " << path);
 
   this->Impl->TestDefine();
-  int id;
-  id = adios_define_var(this->Impl->Group, path.c_str(), "",
-    adios_string, NULL, NULL, NULL);
-  ADIOSUtilities::TestWriteErrorNe(-1, id);
-  this->Impl->GroupSize += v.size();
+  this->Impl->DefineVar(path, adios_string);
+}
+
+//----------------------------------------------------------------------------
+// Build the ADIOS transform specification, "name:parameters"
+static std::string TransformSpec(ADIOS::Transform xfm,
+  const std::string& params)
+{
+  const std::string &name = ADIOS::ToString(xfm);
+  return name.empty() || params.empty() ? name : name + ":" + params;
 }
 
 //----------------------------------------------------------------------------
 template<typename TN>
-void ADIOSWriter::DefineArray(const std::string& path,
-  const std::vector<size_t>& dims, ADIOS::Transform xfm)
+void ADIOSWriter::DefineArray(const std::string& path, size_t numDims,
+  ADIOS::Transform xfm)
 {
-  this->DefineArray(path, dims, ADIOSUtilities::TypeNativeToVTK<TN>::T, xfm);
+  this->DefineArray(path, numDims, ADIOSUtilities::TypeNativeToVTK<TN>::T,
+    xfm);
 }
 #define INSTANTIATE(T) \
 template void ADIOSWriter::DefineArray<T>(const std::string& path, \
-  const std::vector<size_t>& dims, ADIOS::Transform xfm);
+  size_t numDims, ADIOS::Transform xfm);
 INSTANTIATE(int8_t)
 INSTANTIATE(int16_t)
 INSTANTIATE(int32_t)
@@ -213,61 +677,210 @@ INSTANTIATE(double)
 #undef INSTANTIATE
 
 //----------------------------------------------------------------------------
-void ADIOSWriter::DefineArray(const std::string& path,
-  const std::vector<size_t>& dims, int vtkType, ADIOS::Transform xfm)
+void ADIOSWriter::DefineArray(const std::string& path, size_t numDims,
+  int vtkType, ADIOS::Transform xfm, const std::string& xfmParams)
 {
   this->Impl->TestDefine();
   ADIOS_DATATYPES adiosType = ADIOSUtilities::TypeVTKToADIOS(vtkType);
 
-  std::stringstream ssDims;
-  size_t numBytes = ADIOSUtilities::TypeSize(adiosType);
-  for(size_t i = 0; i < dims.size()-1; ++i)
-    {
-    ssDims << dims[i] << ',';
-    numBytes *= dims[i];
-    }
-  ssDims << dims[dims.size()-1];
-  numBytes *= dims[dims.size()-1];
-
-  DebugMacro("Define Array: " << path << " [" << ssDims.str() << "]");
-  int id;
-  id = adios_common_define_var(this->Impl->Group, path.c_str(), "",
-    adiosType, ssDims.str().c_str(), NULL, NULL, 
-    const_cast<char*>(ADIOS::ToString(xfm).c_str()));
-  ADIOSUtilities::TestWriteErrorNe(-1, id);
-  this->Impl->GroupSize += numBytes;
+  // Each dimension is backed by it's own scalar so that the array size can
+  // vary from step to step
+  ADIOSWriterImpl::ArrayInfo &info = this->Impl->GetArrayInfo(path);
+  info.TypeSize = ADIOSUtilities::TypeSize(adiosType);
+  info.GlobalDimIds.clear();
+  info.OffsetIds.clear();
+  std::string dims = this->Impl->DefineDims(path, "Dim", numDims,
+    info.DimIds);
+
+  std::string xfmSpec = TransformSpec(xfm, xfmParams);
+  DebugMacro("Define Array: " << path << " [" << dims << "] " << xfmSpec);
+  info.Id = adios_common_define_var(this->Impl->Group, path.c_str(), "",
+    adiosType, dims.c_str(), NULL, NULL, const_cast<char*>(xfmSpec.c_str()));
+  ADIOSUtilities::TestWriteErrorNe<int64_t>(-1, info.Id);
 }
 
 //----------------------------------------------------------------------------
-void ADIOSWriter::Open(const std::string &fileName, bool append)
+void ADIOSWriter::DefineGlobalArray(const std::string& path, size_t numDims,
+  int vtkType, ADIOS::Transform xfm, const std::string& xfmParams)
 {
-  int err;
+  this->Impl->TestDefine();
+  ADIOS_DATATYPES adiosType = ADIOSUtilities::TypeVTKToADIOS(vtkType);
 
-  const char *mode = append ? "a" : "w";
-  
-  err = adios_open(&this->Impl->File, "VTK", fileName.c_str(), append?"a":"w",
-    ADIOSWriterImpl::Comm);
-  ADIOSUtilities::TestWriteErrorEq(0, err);
+  ADIOSWriterImpl::ArrayInfo &info = this->Impl->GetArrayInfo(path);
+  info.TypeSize = ADIOSUtilities::TypeSize(adiosType);
+  std::string dims = this->Impl->DefineDims(path, "Dim", numDims,
+    info.DimIds);
+  std::string globalDims = this->Impl->DefineDims(path, "GlobalDim", numDims,
+    info.GlobalDimIds);
+  std::string offsets = this->Impl->DefineDims(path, "Offset", numDims,
+    info.OffsetIds);
+
+  std::string xfmSpec = TransformSpec(xfm, xfmParams);
+  DebugMacro("Define Global Array: " << path << " [" << dims << "] in [" <<
+    globalDims << "] at [" << offsets << "] " << xfmSpec);
+  info.Id = adios_common_define_var(this->Impl->Group, path.c_str(), "",
+    adiosType, dims.c_str(), globalDims.c_str(), offsets.c_str(),
+    const_cast<char*>(xfmSpec.c_str()));
+  ADIOSUtilities::TestWriteErrorNe<int64_t>(-1, info.Id);
+}
 
-  err = adios_group_size(this->Impl->File, this->Impl->GroupSize,
-    &this->Impl->TotalSize);
-  ADIOSUtilities::TestWriteErrorEq(0, err);
+//----------------------------------------------------------------------------
+int ADIOSWriter::GetArrayHandle(const std::string& path) const
+{
+  return this->Impl->GetArrayHandle(path);
+}
+
+//----------------------------------------------------------------------------
+void ADIOSWriter::Open(const std::string &fileName, bool append)
+{
+  // The group size is not known until all of this step's data has been
+  // scheduled so the actual ADIOS file gets opened in Close
+  this->Impl->FileName = fileName;
+  this->Impl->Append = append;
+  this->Impl->IsOpen = true;
+  this->Impl->GroupSize = 0;
+  this->Impl->Pending.clear();
 }
 
 //----------------------------------------------------------------------------
 void ADIOSWriter::Close(void)
 {
-  if(this->Impl->File == INVALID_INT64)
+  if(!this->Impl->IsOpen)
     {
     return;
     }
+  this->Impl->IsOpen = false;
 
-  adios_close(this->Impl->File);
-  this->Impl->File = INVALID_INT64;
+  ADIOSWriterImpl::Step *step = new ADIOSWriterImpl::Step;
+  step->FileName = this->Impl->FileName;
+  step->Append = this->Impl->Append;
+  step->GroupSize = this->Impl->GroupSize;
+  step->Writes.swap(this->Impl->Pending);
 
-  int rank = 0;
-  MPI_Comm_rank(ADIOSWriterImpl::Comm, &rank);
-  MPI_Barrier(ADIOSWriterImpl::Comm);
+  if(this->Impl->QueueDepth > 0)
+    {
+    this->Impl->EnqueueStep(step);
+    return;
+    }
+
+  try
+    {
+    this->Impl->CommitStep(*step);
+    }
+  catch(...)
+    {
+    delete step;
+    throw;
+    }
+  delete step;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSWriter::SetAsynchronous(size_t queueDepth)
+{
+  if(this->Impl->IsOpen)
+    {
+    throw std::runtime_error("Unable to change the write mode while a step"
+      " is open");
+    }
+  if(queueDepth == this->Impl->QueueDepth)
+    {
+    return;
+    }
+
+  // Drain anything still queued under the old mode
+  this->Impl->StopIOThread();
+  this->Impl->QueueDepth = 0;
+  this->Impl->TestAsyncError();
+
+  if(queueDepth > 0)
+    {
+    // ADIOS will make MPI calls from the I/O thread
+    int provided;
+    MPI_Query_thread(&provided);
+    if(provided < MPI_THREAD_MULTIPLE)
+      {
+      throw std::runtime_error("Asynchronous writing requires MPI to be "
+        "initialized with MPI_THREAD_MULTIPLE");
+      }
+    this->Impl->QueueDepth = queueDepth;
+    this->Impl->StartIOThread();
+    }
+}
+
+//----------------------------------------------------------------------------
+size_t ADIOSWriter::GetAsynchronous(void) const
+{
+  return this->Impl->QueueDepth;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSWriter::Flush(void)
+{
+  this->Impl->WaitForQueue();
+  this->Impl->TestAsyncError();
+}
+
+//----------------------------------------------------------------------------
+void ADIOSWriter::SetSyncPolicy(ADIOS::SyncPolicy policy)
+{
+  // Don't change the policy out from under a step being written
+  this->Impl->WaitForQueue();
+  this->Impl->SyncPolicy = policy;
+}
+
+//----------------------------------------------------------------------------
+ADIOS::SyncPolicy ADIOSWriter::GetSyncPolicy(void) const
+{
+  return this->Impl->SyncPolicy;
+}
+
+//----------------------------------------------------------------------------
+double ADIOSWriter::GetSyncWaitTime(void)
+{
+  ADIOSWriterImpl::SyncLock.Lock();
+  double t = ADIOSWriterImpl::SyncWaitTime;
+  ADIOSWriterImpl::SyncLock.Unlock();
+  return t;
+}
+
+//----------------------------------------------------------------------------
+void ADIOSWriter::SetBufferHeadroom(double headroom)
+{
+  this->Impl->BufferHeadroom = headroom < 1.0 ? 1.0 : headroom;
+}
+
+//----------------------------------------------------------------------------
+double ADIOSWriter::GetBufferHeadroom(void) const
+{
+  return this->Impl->BufferHeadroom;
+}
+
+//----------------------------------------------------------------------------
+uint64_t ADIOSWriter::GetBufferSize(void) const
+{
+  this->Impl->Lock.Lock();
+  uint64_t size = ADIOSWriterImpl::BufferSizeMB * MB;
+  this->Impl->Lock.Unlock();
+  return size;
+}
+
+//----------------------------------------------------------------------------
+uint64_t ADIOSWriter::GetStepSize(void) const
+{
+  this->Impl->Lock.Lock();
+  uint64_t size = this->Impl->TotalSize;
+  this->Impl->Lock.Unlock();
+  return size;
+}
+
+//----------------------------------------------------------------------------
+size_t ADIOSWriter::GetNumberOfBufferOverflows(void) const
+{
+  this->Impl->Lock.Lock();
+  size_t n = this->Impl->NumberOfBufferOverflows;
+  this->Impl->Lock.Unlock();
+  return n;
 }
 
 //----------------------------------------------------------------------------
@@ -276,11 +889,10 @@ void ADIOSWriter::WriteScalar(const std::string& path, const TN& value)
 {
   DebugMacro( "Write Scalar: " << path);
 
+  this->Impl->TestOpen();
   this->Impl->IsWriting = true;
-
-  int err;
-  err = adios_write(this->Impl->File, path.c_str(), &const_cast<TN&>(value));
-  ADIOSUtilities::TestWriteErrorEq(0, err);
+  this->Impl->ScheduleScalar(this->Impl->GetScalarId(path), &value,
+    sizeof(TN));
 }
 #define INSTANTIATE(T) \
 template void ADIOSWriter::WriteScalar<T>(const std::string& path, \
@@ -305,29 +917,62 @@ void ADIOSWriter::WriteScalar<std::string>(const std::string& path,
 {
   DebugMacro( "Write Scalar: " << path);
 
+  this->Impl->TestOpen();
   this->Impl->IsWriting = true;
-
-  int err;
-  err = adios_write(this->Impl->File, path.c_str(),
-    const_cast<char*>(value.c_str()));
-  ADIOSUtilities::TestWriteErrorEq(0, err);
+  this->Impl->ScheduleScalar(this->Impl->GetScalarId(path), value.c_str(),
+    value.size());
 }
 
 //----------------------------------------------------------------------------
 template<typename TN>
-void ADIOSWriter::WriteArray(const std::string& path, const TN* value)
+void ADIOSWriter::WriteArray(const std::string& path, const TN* value,
+  const std::vector<size_t>& dims)
 {
   DebugMacro( "Write Array: " << path);
 
-  this->Impl->IsWriting = true;
+  std::vector<size_t> none;
+  this->Impl->ScheduleArray(path, value, dims, none, none);
+}
 
-  int err;
-  err = adios_write(this->Impl->File, path.c_str(), const_cast<TN*>(value));
-  ADIOSUtilities::TestWriteErrorEq(0, err);
+//----------------------------------------------------------------------------
+template<typename TN>
+void ADIOSWriter::WriteArray(const std::string& path, const TN* value,
+  const std::vector<size_t>& dims, const std::vector<size_t>& globalDims,
+  const std::vector<size_t>& offsets)
+{
+  DebugMacro( "Write Global Array: " << path);
+
+  this->Impl->ScheduleArray(path, value, dims, globalDims, offsets);
+}
+
+//----------------------------------------------------------------------------
+template<typename TN>
+void ADIOSWriter::WriteArray(int handle, const TN* value,
+  const std::vector<size_t>& dims)
+{
+  std::vector<size_t> none;
+  this->Impl->ScheduleArray(handle, value, dims, none, none);
+}
+
+//----------------------------------------------------------------------------
+template<typename TN>
+void ADIOSWriter::WriteArray(int handle, const TN* value,
+  const std::vector<size_t>& dims, const std::vector<size_t>& globalDims,
+  const std::vector<size_t>& offsets)
+{
+  this->Impl->ScheduleArray(handle, value, dims, globalDims, offsets);
 }
 #define INSTANTIATE(T) \
 template void ADIOSWriter::WriteArray<T>(const std::string& path, \
-  const T* value);
+  const T* value, const std::vector<size_t>& dims); \
+template void ADIOSWriter::WriteArray<T>(const std::string& path, \
+  const T* value, const std::vector<size_t>& dims, \
+  const std::vector<size_t>& globalDims, const std::vector<size_t>& offsets); \
+template void ADIOSWriter::WriteArray<T>(int handle, const T* value, \
+  const std::vector<size_t>& dims); \
+template void ADIOSWriter::WriteArray<T>(int handle, const T* value, \
+  const std::vector<size_t>& dims, const std::vector<size_t>& globalDims, \
+  const std::vector<size_t>& offsets);
 INSTANTIATE(int8_t)
 INSTANTIATE(int16_t)
 INSTANTIATE(int32_t)
@@ -341,4 +986,3 @@ INSTANTIATE(float)
 INSTANTIATE(double)
 INSTANTIATE(void)
 #undef INSTANTIATE
-
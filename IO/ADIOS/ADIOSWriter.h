@@ -19,6 +19,7 @@
 
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 #include <adios_mpi.h>
 
@@ -51,22 +52,41 @@ public:
   void DefineScalar(const std::string& path, const std::string& v);
 
   // Description
-  // Define arrays for later writing
+  // Define arrays for later writing.  Only the number of dimensions is fixed
+  // at definition time; the size of each dimension is stored in an
+  // accompanying scalar written with every step so it may change over time.
   template<typename TN>
-  void DefineArray(const std::string& path, const std::vector<size_t>& dims,
+  void DefineArray(const std::string& path, size_t numDims,
     ADIOS::Transform xfm=ADIOS::Transform_NONE);
 
   // Description
-  // Define arrays for later writing
-  void DefineArray(const std::string& path, const std::vector<size_t>& dims,
-    int vtkType, ADIOS::Transform xfm=ADIOS::Transform_NONE);
+  // Define arrays for later writing.  Transform parameters, if any, are
+  // passed to the ADIOS transform as is, e.g. the compression level.
+  void DefineArray(const std::string& path, size_t numDims,
+    int vtkType, ADIOS::Transform xfm=ADIOS::Transform_NONE,
+    const std::string& xfmParams="");
+
+  // Description
+  // Define global arrays for later writing.  Each block written is placed
+  // within a global index space so readers may select arbitrary sub-regions.
+  // The local, global and offset dimensions are all written per step.
+  void DefineGlobalArray(const std::string& path, size_t numDims,
+    int vtkType, ADIOS::Transform xfm=ADIOS::Transform_NONE,
+    const std::string& xfmParams="");
+
+  // Description
+  // Retrieve the handle of a defined array, or -1 if it hasn't been defined.
+  // Arrays written through their handle skip the lookup by name.
+  int GetArrayHandle(const std::string& path) const;
 
   // Description:
   // Open the vtk group in the ADIOS file for writing one timestep
   void Open(const std::string &fileName, bool append = false);
 
   // Description:
-  // Close the VTK group for the current time step in the ADIOS file
+  // Close the VTK group for the current time step in the ADIOS file.  The
+  // group size is computed from the data scheduled since Open and all
+  // scheduled writes are committed here.
   void Close(void);
 
   // Description
@@ -75,9 +95,76 @@ public:
   void WriteScalar(const std::string& path, const TN& value);
 
   // Description
-  // Schedule arrays for writing
+  // Schedule arrays for writing with the dimensions of the current step.
+  // The data must remain valid until Close.
+  template<typename TN>
+  void WriteArray(const std::string& path, const TN* value,
+    const std::vector<size_t>& dims);
+
+  // Description
+  // Schedule global arrays for writing with the local dimensions, global
+  // dimensions and local offsets of the current step.  The data must remain
+  // valid until Close.
   template<typename TN>
-  void WriteArray(const std::string& path, const TN* value);
+  void WriteArray(const std::string& path, const TN* value,
+    const std::vector<size_t>& dims, const std::vector<size_t>& globalDims,
+    const std::vector<size_t>& offsets);
+
+  // Description
+  // Schedule arrays for writing by the handle returned from GetArrayHandle
+  template<typename TN>
+  void WriteArray(int handle, const TN* value,
+    const std::vector<size_t>& dims);
+
+  template<typename TN>
+  void WriteArray(int handle, const TN* value,
+    const std::vector<size_t>& dims, const std::vector<size_t>& globalDims,
+    const std::vector<size_t>& offsets);
+
+  // Description:
+  // Get/Set asynchronous writing.  When queueDepth is non-zero, Close
+  // snapshots the step's data and returns immediately while a background
+  // thread performs the ADIOS open, write and close.  At most queueDepth
+  // steps are buffered before Close blocks.  Requires MPI to be initialized
+  // with MPI_THREAD_MULTIPLE.  A depth of 0 (default) writes synchronously.
+  void SetAsynchronous(size_t queueDepth);
+  size_t GetAsynchronous(void) const;
+
+  // Description:
+  // Block until all asynchronously queued steps have been written.  Any
+  // error raised while writing in the background is thrown from here.
+  void Flush(void);
+
+  // Description:
+  // Get/Set how ranks are synchronized after each step is closed: with a
+  // barrier on every step (default), not at all, or once at finalization
+  void SetSyncPolicy(ADIOS::SyncPolicy policy);
+  ADIOS::SyncPolicy GetSyncPolicy(void) const;
+
+  // Description:
+  // Retrieve the total time in seconds this process has spent waiting on
+  // other ranks in writer synchronization
+  static double GetSyncWaitTime(void);
+
+  // Description:
+  // Get/Set the factor applied to the size of a step when growing the ADIOS
+  // buffer (default 1.25).  Values less than 1 are clamped to 1.
+  void SetBufferHeadroom(double headroom);
+  double GetBufferHeadroom(void) const;
+
+  // Description:
+  // Retrieve the currently allocated ADIOS buffer size in bytes
+  uint64_t GetBufferSize(void) const;
+
+  // Description:
+  // Retrieve the total size in bytes, including ADIOS overhead, of the last
+  // step written
+  uint64_t GetStepSize(void) const;
+
+  // Description:
+  // Retrieve the number of steps which did not fit in the buffer and forced
+  // ADIOS to flush part way through the step
+  size_t GetNumberOfBufferOverflows(void) const;
 
 protected:
   struct ADIOSWriterImpl;
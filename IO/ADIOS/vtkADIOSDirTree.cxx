@@ -12,11 +12,156 @@
      PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
+#include <cstring>
 #include <map>
 #include <stdexcept>
 
 #include "vtkADIOSDirTree.h"
 
+typedef std::map<std::string, vtkADIOSDirTree> SubDirMap;
+typedef std::map<std::string, const ADIOSVarInfo*> VarMap;
+
+//----------------------------------------------------------------------------
+// An open addressing hash table of every directory and variable in a tree
+// keyed by the id of the containing directory and the name within it.  The
+// names point at the keys of the tree's maps so entries never own strings.
+struct vtkADIOSDirTree::PathIndex
+{
+  struct Entry
+  {
+    Entry(void) : Parent(-1), Name(NULL), Dir(NULL), Var(NULL) { }
+    int Parent;
+    const std::string *Name;
+    vtkADIOSDirTree *Dir;
+    const ADIOSVarInfo *Var;
+  };
+
+  PathIndex(void) : Table(64), Size(0), NumberOfDirs(1) { }
+
+  // FNV-1a over the parent id and the name
+  static size_t Hash(int parent, const char* name, size_t len)
+  {
+    size_t h = 2166136261U;
+    h = (h ^ static_cast<size_t>(parent)) * 16777619U;
+    for(size_t i = 0; i < len; ++i)
+      {
+      h = (h ^ static_cast<unsigned char>(name[i])) * 16777619U;
+      }
+    return h;
+  }
+
+  // Find the slot holding the entry, or the empty slot where it would go
+  size_t Probe(int parent, const char* name, size_t len) const
+  {
+    size_t mask = this->Table.size() - 1;
+    size_t i = Hash(parent, name, len) & mask;
+    while(this->Table[i].Parent >= 0)
+      {
+      const Entry &e = this->Table[i];
+      if(e.Parent == parent && e.Name->size() == len &&
+         std::memcmp(e.Name->data(), name, len) == 0)
+        {
+        break;
+        }
+      i = (i + 1) & mask;
+      }
+    return i;
+  }
+
+  const Entry* Find(int parent, const char* name, size_t len) const
+  {
+    const Entry &e = this->Table[this->Probe(parent, name, len)];
+    return e.Parent >= 0 ? &e : NULL;
+  }
+
+  Entry& Insert(int parent, const std::string* name)
+  {
+    // Keep the table at most half full so probe sequences stay short
+    if(2 * (this->Size + 1) > this->Table.size())
+      {
+      std::vector<Entry> old(this->Table.size() * 2);
+      old.swap(this->Table);
+      for(size_t i = 0; i < old.size(); ++i)
+        {
+        if(old[i].Parent >= 0)
+          {
+          this->Table[this->Probe(old[i].Parent, old[i].Name->data(),
+            old[i].Name->size())] = old[i];
+          }
+        }
+      }
+
+    Entry &e = this->Table[this->Probe(parent, name->data(), name->size())];
+    if(e.Parent < 0)
+      {
+      e.Parent = parent;
+      e.Name = name;
+      ++this->Size;
+      }
+    return e;
+  }
+
+  std::vector<Entry> Table;
+  size_t Size;
+  int NumberOfDirs;
+};
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree::vtkADIOSDirTree(void)
+: Id(0), Index(NULL), OwnsIndex(false)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree::vtkADIOSDirTree(const vtkADIOSDirTree& other)
+: Variables(other.Variables), SubDirs(other.SubDirs), Id(0), Index(NULL),
+  OwnsIndex(false)
+{
+  // The names in an index point into the maps of the tree it was built for
+  // so copies get their own
+  if(other.Index)
+    {
+    this->Index = new PathIndex;
+    this->OwnsIndex = true;
+    this->Reindex();
+    }
+}
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree::~vtkADIOSDirTree(void)
+{
+  if(this->OwnsIndex)
+    {
+    delete this->Index;
+    }
+}
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree& vtkADIOSDirTree::operator=(const vtkADIOSDirTree& other)
+{
+  if(this == &other)
+    {
+    return *this;
+    }
+
+  this->Variables = other.Variables;
+  this->SubDirs = other.SubDirs;
+  if(this->OwnsIndex)
+    {
+    delete this->Index;
+    }
+  this->Id = 0;
+  this->Index = NULL;
+  this->OwnsIndex = false;
+  if(other.Index)
+    {
+    this->Index = new PathIndex;
+    this->OwnsIndex = true;
+    this->Reindex();
+    }
+  return *this;
+}
+
 //----------------------------------------------------------------------------
 void vtkADIOSDirTree::Tokenize(const std::string& str,
   std::vector<std::string> &tok, char d)
@@ -53,27 +198,22 @@ void vtkADIOSDirTree::PrintSelf(std::ostream& os, vtkIndent indent) const
   vtkIndent indent2 = indent.GetNextIndent();
   vtkIndent indent3 = indent2.GetNextIndent();
 
-  if(this->Scalars.size() > 0)
+  for(VarMapIt i = this->Variables.begin(); i != this->Variables.end(); ++i)
     {
-    for(VarMapIt i = this->Scalars.begin(); i != this->Scalars.end(); ++i)
+    if(i->second->IsScalar())
       {
       os << indent << "Scalar: " << i->first << std::endl;
+      continue;
       }
-    }
 
-  if(this->Arrays.size() > 0)
-    {
-    for(VarMapIt i = this->Arrays.begin(); i != this->Arrays.end(); ++i)
+    os << indent << "Array: " << i->first << '[';
+    std::vector<size_t> dims;
+    i->second->GetDims(dims);
+    for(size_t i = 0; i < dims.size()-1; ++i)
       {
-      os << indent << "Array: " << i->first << '[';
-      std::vector<size_t> dims;
-      i->second->GetDims(dims);
-      for(size_t i = 0; i < dims.size()-1; ++i)
-        {
-        os << dims[i] << ',';
-        }
-      os << dims[dims.size()-1] << ']' << std::endl;
+      os << dims[i] << ',';
       }
+    os << dims[dims.size()-1] << ']' << std::endl;
     }
 
   for(DirMapIt i = this->SubDirs.begin(); i != this->SubDirs.end(); ++i)
@@ -87,85 +227,255 @@ void vtkADIOSDirTree::PrintSelf(std::ostream& os, vtkIndent indent) const
 void vtkADIOSDirTree::BuildDirTree(const ADIOSReader &reader)
 {
   typedef std::vector<ADIOSVarInfo*>::const_iterator VarIt;
-  std::vector<std::string> fullPath;
 
-  // Pupulate scalars
-  const std::vector<ADIOSVarInfo*>& scalars = reader.GetScalars();
-  for(VarIt i = scalars.begin(); i != scalars.end(); ++i)
+  // Walk each name in place rather than tokenizing it so that only new
+  // directories and variables allocate
+  this->Clear();
+  const std::vector<ADIOSVarInfo*>& vars = reader.GetVariables();
+  for(VarIt i = vars.begin(); i != vars.end(); ++i)
+    {
+    const std::string &name = (*i)->GetName();
+    size_t end = name.size();
+    while(end > 0 && name[end-1] == '/')
+      {
+      --end;
+      }
+    size_t start = end;
+    while(start > 0 && name[start-1] != '/')
+      {
+      --start;
+      }
+    if(start == end)
+      {
+      continue;
+      }
+
+    vtkADIOSDirTree *subDir = this->WalkPath(name.data(), start, 0, true);
+    subDir->AddVar(name.substr(start, end-start), *i);
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSDirTree::Clear(void)
+{
+  this->Variables.clear();
+  this->SubDirs.clear();
+  if(this->OwnsIndex)
+    {
+    delete this->Index;
+    }
+  this->Id = 0;
+  this->Index = new PathIndex;
+  this->OwnsIndex = true;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSDirTree::Reindex(void)
+{
+  for(SubDirMap::iterator d = this->SubDirs.begin();
+    d != this->SubDirs.end(); ++d)
     {
-    Tokenize((*i)->GetName(), fullPath);
-    vtkADIOSDirTree *subDir = this->GetDir(fullPath, 1, true);
-    subDir->Scalars[fullPath[fullPath.size()-1]] = *i;
+    vtkADIOSDirTree &subDir = d->second;
+    if(subDir.OwnsIndex)
+      {
+      delete subDir.Index;
+      }
+    subDir.Index = this->Index;
+    subDir.OwnsIndex = false;
+    subDir.Id = this->Index->NumberOfDirs++;
+    this->Index->Insert(this->Id, &d->first).Dir = &subDir;
+    subDir.Reindex();
     }
 
-  // Pupulate arrays
-  const std::vector<ADIOSVarInfo*>& arrays = reader.GetArrays();
-  for(VarIt i = arrays.begin(); i != arrays.end(); ++i)
+  for(VarMap::iterator v = this->Variables.begin();
+    v != this->Variables.end(); ++v)
     {
-    Tokenize((*i)->GetName(), fullPath);
-    vtkADIOSDirTree *subDir = this->GetDir(fullPath, 1, true);
-    subDir->Arrays[fullPath[fullPath.size()-1]] = *i;
+    this->Index->Insert(this->Id, &v->first).Var = v->second;
     }
 }
 
 //----------------------------------------------------------------------------
-vtkADIOSDirTree* vtkADIOSDirTree::GetDir(const std::vector<std::string>& path,
+vtkADIOSDirTree* vtkADIOSDirTree::AddDir(const std::string& name)
+{
+  if(!this->Index)
+    {
+    this->Index = new PathIndex;
+    this->OwnsIndex = true;
+    }
+
+  SubDirMap::iterator d = this->SubDirs.insert(
+    SubDirMap::value_type(name, vtkADIOSDirTree())).first;
+  PathIndex::Entry &e = this->Index->Insert(this->Id, &d->first);
+  if(!e.Dir)
+    {
+    e.Dir = &d->second;
+    e.Dir->Index = this->Index;
+    e.Dir->Id = this->Index->NumberOfDirs++;
+    }
+  return e.Dir;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSDirTree::AddVar(const std::string& name,
+  const ADIOSVarInfo* var)
+{
+  if(!this->Index)
+    {
+    this->Index = new PathIndex;
+    this->OwnsIndex = true;
+    }
+
+  VarMap::iterator v = this->Variables.insert(
+    VarMap::value_type(name, var)).first;
+  v->second = var;
+  this->Index->Insert(this->Id, &v->first).Var = var;
+}
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree* vtkADIOSDirTree::FindDir(const char* name, size_t len) const
+{
+  const PathIndex::Entry *e = this->Index ?
+    this->Index->Find(this->Id, name, len) : NULL;
+  return e ? e->Dir : NULL;
+}
+
+//----------------------------------------------------------------------------
+const ADIOSVarInfo* vtkADIOSDirTree::FindVar(const char* name,
+  size_t len) const
+{
+  const PathIndex::Entry *e = this->Index ?
+    this->Index->Find(this->Id, name, len) : NULL;
+  return e ? e->Var : NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree* vtkADIOSDirTree::WalkPath(const char* path, size_t len,
   size_t numDrop, bool createPath)
 {
-  typedef std::map<std::string, vtkADIOSDirTree> SubDirMap;
-  
+  // Count the non-empty components so the last numDrop can be left off
+  size_t numComponents = 0;
+  for(size_t i = 0; i < len;)
+    {
+    while(i < len && path[i] == '/')
+      {
+      ++i;
+      }
+    if(i == len)
+      {
+      break;
+      }
+    ++numComponents;
+    while(i < len && path[i] != '/')
+      {
+      ++i;
+      }
+    }
+  if(numDrop > numComponents)
+    {
+    return NULL;
+    }
+
   vtkADIOSDirTree* curTree = this;
-  for(size_t i = 0; i < path.size() - numDrop; ++i)
+  size_t pos = 0;
+  for(size_t c = 0; c < numComponents - numDrop; ++c)
     {
-    const std::string &name = path[i];
-    SubDirMap::iterator subDir = curTree->SubDirs.find(name);
-    if(subDir == curTree->SubDirs.end())
+    while(path[pos] == '/')
+      {
+      ++pos;
+      }
+    size_t start = pos;
+    while(pos < len && path[pos] != '/')
+      {
+      ++pos;
+      }
+
+    vtkADIOSDirTree *subDir = curTree->FindDir(path+start, pos-start);
+    if(!subDir)
       {
       if(!createPath)
         {
         return NULL;
         }
-      subDir = curTree->SubDirs.insert(
-        SubDirMap::value_type(name, vtkADIOSDirTree())).first;
+      subDir = curTree->AddDir(std::string(path+start, pos-start));
       }
-    curTree = &subDir->second;
+    curTree = subDir;
     }
   return curTree;
 }
 
 //----------------------------------------------------------------------------
-const vtkADIOSDirTree* vtkADIOSDirTree::GetDir(
-  const std::vector<std::string>& path, size_t numDrop) const
+vtkADIOSDirTree* vtkADIOSDirTree::GetDir(const std::string& path,
+  size_t numDrop, bool createPath)
+{
+  return this->WalkPath(path.data(), path.size(), numDrop, createPath);
+}
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree* vtkADIOSDirTree::GetDir(const char* path, size_t numDrop,
+  bool createPath)
+{
+  return this->WalkPath(path, std::strlen(path), numDrop, createPath);
+}
+
+//----------------------------------------------------------------------------
+vtkADIOSDirTree* vtkADIOSDirTree::GetDir(const std::vector<std::string>& path,
+  size_t numDrop, bool createPath)
 {
-  typedef std::map<std::string, vtkADIOSDirTree> SubDirMap;
-  
-  const vtkADIOSDirTree* curTree = this;
+  if(numDrop > path.size())
+    {
+    return NULL;
+    }
+
+  vtkADIOSDirTree* curTree = this;
   for(size_t i = 0; i < path.size() - numDrop; ++i)
     {
     const std::string &name = path[i];
-    SubDirMap::const_iterator subDir = curTree->SubDirs.find(name);
-    if(subDir == curTree->SubDirs.end())
+    vtkADIOSDirTree *subDir = curTree->FindDir(name.data(), name.size());
+    if(!subDir)
       {
-      return NULL;
+      if(!createPath)
+        {
+        return NULL;
+        }
+      subDir = curTree->AddDir(name);
       }
-    curTree = &subDir->second;
+    curTree = subDir;
     }
   return curTree;
 }
 
+//----------------------------------------------------------------------------
+const vtkADIOSDirTree* vtkADIOSDirTree::GetDir(const std::string& path,
+  size_t numDrop) const
+{
+  return const_cast<vtkADIOSDirTree*>(this)->WalkPath(path.data(),
+    path.size(), numDrop, false);
+}
+
+//----------------------------------------------------------------------------
+const vtkADIOSDirTree* vtkADIOSDirTree::GetDir(const char* path,
+  size_t numDrop) const
+{
+  return const_cast<vtkADIOSDirTree*>(this)->WalkPath(path,
+    std::strlen(path), numDrop, false);
+}
+
+//----------------------------------------------------------------------------
+const vtkADIOSDirTree* vtkADIOSDirTree::GetDir(
+  const std::vector<std::string>& path, size_t numDrop) const
+{
+  return const_cast<vtkADIOSDirTree*>(this)->GetDir(path, numDrop, false);
+}
+
 //----------------------------------------------------------------------------
 const ADIOSVarInfo* vtkADIOSDirTree::operator[](
   const std::string& varName) const
 {
-  std::map<std::string, const ADIOSVarInfo*>::const_iterator i;
+  return this->FindVar(varName.data(), varName.size());
+}
 
-  if((i = this->Scalars.find(varName)) != this->Scalars.end())
-    {
-    return i->second;
-    }
-  if((i = this->Arrays.find(varName)) != this->Arrays.end())
-    {
-    return i->second;
-    }
-  return NULL;
+//----------------------------------------------------------------------------
+const ADIOSVarInfo* vtkADIOSDirTree::operator[](const char* varName) const
+{
+  return this->FindVar(varName, std::strlen(varName));
 }
@@ -29,47 +29,84 @@
 
 struct vtkADIOSDirTree
 {
-  std::map<std::string, const ADIOSVarInfo*> Scalars;
-  std::map<std::string, const ADIOSVarInfo*> Arrays;
+  std::map<std::string, const ADIOSVarInfo*> Variables;
   std::map<std::string, vtkADIOSDirTree> SubDirs;
 
+  // Description:
+  // The id of the directory within its tree, the root being 0.  Ids are
+  // assigned when the tree is built and are stable for the life of the tree.
+  int Id;
+
+  vtkADIOSDirTree(void);
+  vtkADIOSDirTree(const vtkADIOSDirTree& other);
+  ~vtkADIOSDirTree(void);
+  vtkADIOSDirTree& operator=(const vtkADIOSDirTree& other);
+
   void PrintSelf(std::ostream& os, vtkIndent indent) const;
 
   // Description:
-  // Cosntruct a directory tree form pre-cached ADIOS data
+  // Cosntruct a directory tree from the ADIOS variable names.  This doesn't
+  // inquire any variable metadata.
   void BuildDirTree(const ADIOSReader &reader);
 
   // Description:
-  // Retrieve a directory object
+  // Retrieve a directory object.  Lookups go through the tree's flat path
+  // index, one hash probe per path component, and never allocate.
   vtkADIOSDirTree* GetDir(const std::string& path, size_t numDrop = 0,
-    bool createPath = false)
-  {
-    std::vector<std::string> tok;
-    Tokenize(path, tok);
-    return GetDir(tok, numDrop, createPath);
-  }
+    bool createPath = false);
+  vtkADIOSDirTree* GetDir(const char* path, size_t numDrop = 0,
+    bool createPath = false);
 
   vtkADIOSDirTree* GetDir(const std::vector<std::string>& path,
     size_t numDrop, bool createPath);
 
   const vtkADIOSDirTree* GetDir(const std::string& path,
-    size_t numDrop = 0) const
-  {
-    std::vector<std::string> tok;
-    Tokenize(path, tok);
-    return GetDir(tok, numDrop);
-  }
+    size_t numDrop = 0) const;
+  const vtkADIOSDirTree* GetDir(const char* path, size_t numDrop = 0) const;
   const vtkADIOSDirTree* GetDir(const std::vector<std::string>& path,
     size_t numDrop = 0) const;
 
   // Description:
   // Access variables by name
   const ADIOSVarInfo* operator[](const std::string& name) const;
+  const ADIOSVarInfo* operator[](const char* name) const;
 
   // Description:
   // A helper function to split a string into delimited components
   static void Tokenize(const std::string& path, std::vector<std::string>& split,
     char delim='/');
+
+protected:
+  struct PathIndex;
+
+  // Description:
+  // Find the named directory or variable directly within this directory
+  vtkADIOSDirTree* FindDir(const char* name, size_t len) const;
+  const ADIOSVarInfo* FindVar(const char* name, size_t len) const;
+
+  // Description:
+  // Walk all but the last numDrop components of a '/' delimited path,
+  // creating missing directories if requested
+  vtkADIOSDirTree* WalkPath(const char* path, size_t len, size_t numDrop,
+    bool createPath);
+
+  // Description:
+  // Add a sub directory or variable to this directory and the index
+  vtkADIOSDirTree* AddDir(const std::string& name);
+  void AddVar(const std::string& name, const ADIOSVarInfo* var);
+
+  // Description:
+  // Drop everything in the tree and start a new, empty, index
+  void Clear(void);
+
+  // Description:
+  // Add this directory's contents, and those of its sub directories, to the
+  // index
+  void Reindex(void);
+
+  // The index shared by every directory in the tree.  Only the root owns it.
+  PathIndex *Index;
+  bool OwnsIndex;
 };
 
 #endif
@@ -12,12 +12,17 @@
      PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <sstream>
 #include <stdexcept>
 #include <limits>
 
 #include <vtkObjectFactory.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkDataArraySelection.h>
 #include <vtkType.h>
 #include <vtkInformation.h>
 #include <vtkInformationVector.h>
@@ -37,8 +42,11 @@
 #include <vtkImageData.h>
 #include <vtkPolyData.h>
 #include <vtkUnstructuredGrid.h>
+#include <vtkCellType.h>
 
 #include "vtkADIOSReader.h"
+#include "ADIOSReader.h"
+#include "ADIOSUtilities.h"
 #include "ADIOSVarInfo.h"
 
 #define TEST_OBJECT_TYPE(subDir, objType) \
@@ -47,8 +55,9 @@
     return NULL; \
     } \
  \
-  const ADIOSVarInfo *v = (*subDir)["vtkDataObjectType"]; \
-  if(!(v && v->IsScalar() && v->GetValue<vtkTypeUInt8>() == objType)) \
+  const ADIOSVarInfo *v = (*subDir)["DataObjectType"]; \
+  if(!(v && v->IsScalar() && v->GetValue<vtkTypeUInt8>( \
+    this->RequestStepIndex, this->ReadBlock) == objType)) \
     { \
     return NULL; \
     }
@@ -58,20 +67,339 @@ typedef std::map<std::string, vtkADIOSDirTree> SubDirMap;
 typedef std::map<std::string, const ADIOSVarInfo*> VarMap;
 const double INVALID_STEP = std::numeric_limits<double>::min();
 
+//----------------------------------------------------------------------------
+// Whether a variable is one of the scalars holding the dimensions of a
+// sibling array, named <array>_Dim<i>, <array>_GlobalDim<i> or
+// <array>_Offset<i>
+static bool IsDimensionVariable(const VarMap& vars, const std::string& name)
+{
+  size_t digits = name.find_last_not_of("0123456789");
+  if(digits == std::string::npos || digits+1 == name.size())
+    {
+    return false;
+    }
+
+  const char *suffixes[3] = { "_Dim", "_GlobalDim", "_Offset" };
+  for(int s = 0; s < 3; ++s)
+    {
+    size_t len = std::strlen(suffixes[s]);
+    if(digits+1 > len &&
+      name.compare(digits+1-len, len, suffixes[s]) == 0 &&
+      vars.count(name.substr(0, digits+1-len)))
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+// Create a multi-piece data set holding shallow copies of all pieces of
+// another, optionally accumulating their memory size in kibibytes
+static vtkMultiPieceDataSet* ShallowCopyPieces(vtkMultiPieceDataSet *src,
+  unsigned long *size = NULL)
+{
+  vtkMultiPieceDataSet *dst = vtkMultiPieceDataSet::New();
+  dst->SetNumberOfPieces(src->GetNumberOfPieces());
+  for(unsigned int i = 0; i < src->GetNumberOfPieces(); ++i)
+    {
+    vtkDataObject *piece = src->GetPiece(i);
+    if(!piece)
+      {
+      continue;
+      }
+    vtkDataObject *copy = piece->NewInstance();
+    copy->ShallowCopy(piece);
+    dst->SetPiece(i, copy);
+    copy->Delete();
+    if(size)
+      {
+      *size += piece->GetActualMemorySize();
+      }
+    }
+  return dst;
+}
+
+//----------------------------------------------------------------------------
+// Assign each block to the part its midpoint falls in when the blocks are
+// laid end to end by size, giving contiguous [begin,end) ranges of roughly
+// equal total size.  Falls back to equal block counts if all are empty.
+static void PartitionBlocks(const std::vector<double>& sizes, int numParts,
+  int part, int& begin, int& end)
+{
+  double total = 0.0;
+  for(size_t i = 0; i < sizes.size(); ++i)
+    {
+    total += sizes[i];
+    }
+
+  begin = end = 0;
+  double offset = 0.0;
+  for(size_t i = 0; i < sizes.size(); ++i)
+    {
+    int p = total > 0.0 ?
+      static_cast<int>((offset + 0.5*sizes[i]) * numParts / total) :
+      static_cast<int>(i * numParts / sizes.size());
+    p = std::min(p, numParts-1);
+    offset += sizes[i];
+
+    if(p < part)
+      {
+      begin = end = i+1;
+      }
+    else if(p == part)
+      {
+      end = i+1;
+      }
+    }
+}
+
 //----------------------------------------------------------------------------
 
 vtkADIOSReader::vtkADIOSReader()
 : FileName(""), ReadMethod(ADIOS_READ_METHOD_BP), ReadMethodArguments(""),
-  Reader(NULL), NumberOfPieces(-1), Output(NULL)
+  SynchronizationPolicy(ADIOS::SyncPolicy_Barrier), BroadcastMetadata(false),
+  MetadataIndex(false), HasValueRange(false), Reader(NULL),
+  UpdatingArraySelections(false),
+  CacheMemoryLimit(0), Prefetch(false), Prefetching(false), LastStepIndex(-1),
+  NumberOfPieces(-1), ReadBlock(0), ReadStepIndex(0), GlobalImage(false),
+  HasRequestExtent(false), Output(NULL)
 {
+  std::fill(this->WholeExtent, this->WholeExtent+6, 0);
+  std::fill(this->RequestExtent, this->RequestExtent+6, 0);
+  std::fill(this->ValueRange, this->ValueRange+2, 0.0);
   this->SetNumberOfInputPorts(0);
   this->SetNumberOfOutputPorts(1);
+
+  this->PointDataArraySelection = vtkDataArraySelection::New();
+  this->CellDataArraySelection = vtkDataArraySelection::New();
+  this->FieldDataArraySelection = vtkDataArraySelection::New();
+  this->SelectionObserver = vtkCallbackCommand::New();
+  this->SelectionObserver->SetCallback(
+    &vtkADIOSReader::SelectionModifiedCallback);
+  this->SelectionObserver->SetClientData(this);
+  this->PointDataArraySelection->AddObserver(vtkCommand::ModifiedEvent,
+    this->SelectionObserver);
+  this->CellDataArraySelection->AddObserver(vtkCommand::ModifiedEvent,
+    this->SelectionObserver);
+  this->FieldDataArraySelection->AddObserver(vtkCommand::ModifiedEvent,
+    this->SelectionObserver);
 }
 
 //----------------------------------------------------------------------------
 vtkADIOSReader::~vtkADIOSReader()
 {
-  delete this->Reader;
+  if(this->Reader)
+    {
+    this->Reader->SetSyncPolicy(this->SynchronizationPolicy);
+    delete this->Reader;
+    }
+
+  this->PointDataArraySelection->RemoveObserver(this->SelectionObserver);
+  this->CellDataArraySelection->RemoveObserver(this->SelectionObserver);
+  this->FieldDataArraySelection->RemoveObserver(this->SelectionObserver);
+  this->SelectionObserver->Delete();
+  this->PointDataArraySelection->Delete();
+  this->CellDataArraySelection->Delete();
+  this->FieldDataArraySelection->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::SelectionModifiedCallback(vtkObject*, unsigned long,
+  void* clientdata, void*)
+{
+  vtkADIOSReader *self = static_cast<vtkADIOSReader*>(clientdata);
+  self->ReadPlans.clear();
+  if(!self->UpdatingArraySelections)
+    {
+    self->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetNumberOfPointArrays(void)
+{
+  return this->PointDataArraySelection->GetNumberOfArrays();
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetNumberOfCellArrays(void)
+{
+  return this->CellDataArraySelection->GetNumberOfArrays();
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetNumberOfFieldArrays(void)
+{
+  return this->FieldDataArraySelection->GetNumberOfArrays();
+}
+
+//----------------------------------------------------------------------------
+const char* vtkADIOSReader::GetPointArrayName(int index)
+{
+  return this->PointDataArraySelection->GetArrayName(index);
+}
+
+//----------------------------------------------------------------------------
+const char* vtkADIOSReader::GetCellArrayName(int index)
+{
+  return this->CellDataArraySelection->GetArrayName(index);
+}
+
+//----------------------------------------------------------------------------
+const char* vtkADIOSReader::GetFieldArrayName(int index)
+{
+  return this->FieldDataArraySelection->GetArrayName(index);
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetPointArrayStatus(const char* name)
+{
+  return this->PointDataArraySelection->ArrayIsEnabled(name);
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetCellArrayStatus(const char* name)
+{
+  return this->CellDataArraySelection->ArrayIsEnabled(name);
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetFieldArrayStatus(const char* name)
+{
+  return this->FieldDataArraySelection->ArrayIsEnabled(name);
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::SetPointArrayStatus(const char* name, int status)
+{
+  if(status)
+    {
+    this->PointDataArraySelection->EnableArray(name);
+    }
+  else
+    {
+    this->PointDataArraySelection->DisableArray(name);
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::SetCellArrayStatus(const char* name, int status)
+{
+  if(status)
+    {
+    this->CellDataArraySelection->EnableArray(name);
+    }
+  else
+    {
+    this->CellDataArraySelection->DisableArray(name);
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::SetFieldArrayStatus(const char* name, int status)
+{
+  if(status)
+    {
+    this->FieldDataArraySelection->EnableArray(name);
+    }
+  else
+    {
+    this->FieldDataArraySelection->DisableArray(name);
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetArrayErrorBoundMode(const char* path)
+{
+  const ADIOSAttribute *a = this->FindAttribute(
+    std::string(path) + "/ErrorBoundMode");
+  return a ? a->GetValue<int>() : -1;
+}
+
+//----------------------------------------------------------------------------
+double vtkADIOSReader::GetArrayErrorTolerance(const char* path)
+{
+  const ADIOSAttribute *a = this->FindAttribute(
+    std::string(path) + "/ErrorTolerance");
+  return a ? a->GetValue<double>() : 0.0;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::SetValueRange(const char* arrayName, double min,
+  double max)
+{
+  if(!arrayName)
+    {
+    this->RemoveValueRange();
+    return;
+    }
+  if(this->HasValueRange && this->ValueRangeArray == arrayName &&
+    this->ValueRange[0] == min && this->ValueRange[1] == max)
+    {
+    return;
+    }
+  this->HasValueRange = true;
+  this->ValueRangeArray = arrayName;
+  this->ValueRange[0] = min;
+  this->ValueRange[1] = max;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::RemoveValueRange(void)
+{
+  if(this->HasValueRange)
+    {
+    this->HasValueRange = false;
+    this->ValueRangeArray.clear();
+    this->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkADIOSReader::BlockIntersectsValueRange(const vtkADIOSDirTree *dir,
+  int block)
+{
+  if(!this->HasValueRange || !dir)
+    {
+    return true;
+    }
+
+  const char *attrNames[2] = { "PointData", "CellData" };
+  for(int a = 0; a < 2; ++a)
+    {
+    const vtkADIOSDirTree *d = dir->GetDir(attrNames[a]);
+    const ADIOSVarInfo *v = d ? (*d)[this->ValueRangeArray] : NULL;
+    double range[2];
+    if(v && !v->IsScalar() &&
+      v->GetRange(this->RequestStepIndex, block, range))
+      {
+      return range[0] <= this->ValueRange[1] &&
+        range[1] >= this->ValueRange[0];
+      }
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+const ADIOSAttribute* vtkADIOSReader::FindAttribute(const std::string& name)
+{
+  if(!this->Reader || !this->Reader->IsOpen())
+    {
+    return NULL;
+    }
+
+  const std::vector<ADIOSAttribute*>& attrs = this->Reader->GetAttributes();
+  for(std::vector<ADIOSAttribute*>::const_iterator a = attrs.begin();
+    a != attrs.end(); ++a)
+    {
+    if((*a)->GetName() == name)
+      {
+      return *a;
+      }
+    }
+  return NULL;
 }
 
 //----------------------------------------------------------------------------
@@ -88,11 +416,15 @@ void vtkADIOSReader::SetController(vtkMPIController *controller)
     this->Controller->GetCommunicator())->GetMPIComm()->GetHandle(),
     this->ReadMethod, this->ReadMethodArguments);
 
+  // Deleting the reader waits for any prefetch, which is dropped since
+  // nothing is left to finish it with
   if(this->Reader)
     {
     delete this->Reader;
     }
   this->Reader = new ADIOSReader;
+  this->PrefetchPieces = NULL;
+  this->DiscardReads();
 }
 
 //----------------------------------------------------------------------------
@@ -112,6 +444,9 @@ int vtkADIOSReader::ProcessRequest(vtkInformation* request,
     return false;
     }
 
+  // A prefetch may still be reading from the file on a worker thread
+  this->WaitForPrefetch();
+
   if(request->Has(vtkDemandDrivenPipeline::REQUEST_INFORMATION()))
     {
     return this->RequestInformation(request, input, output);
@@ -153,14 +488,14 @@ bool vtkADIOSReader::RequestInformation(vtkInformation *req,
       }
 
     // 2: Make sure we have the ones we need
-    if(this->NumberOfPieces != -1)
+    if(this->NumberOfPieces == -1)
       {
       vtkWarningMacro(<< "NumberOfPieces attribute not present.  Assuming 1");
       this->NumberOfPieces = 1;
       }
 
-    // 3: Retrieve the time steps
-    const ADIOSVarInfo *varTimeSteps = this->Tree.Scalars["/TimeSteps"];
+    // 3: Retrieve the time steps, one value of which is written per step
+    const ADIOSVarInfo *varTimeSteps = this->Tree["TimeStamp"];
     const double *ptrTimeSteps = varTimeSteps->GetAllValues<double>();
     this->TimeSteps.clear();
     this->TimeSteps.reserve(varTimeSteps->GetNumSteps());
@@ -200,9 +535,64 @@ bool vtkADIOSReader::RequestInformation(vtkInformation *req,
   tRange[1] = *this->TimeSteps.rbegin();
   outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_RANGE(), tRange, 2);
 
+  // Image data written as global arrays can be requested by extent
+  const vtkADIOSDirTree *root = this->Tree.GetDir("/");
+  const ADIOSVarInfo *vType = root ? (*root)["DataObjectType"] : NULL;
+  this->GlobalImage = vType && (*root)["WholeExtentXMin"] &&
+    vType->GetValue<vtkTypeUInt8>() == VTK_IMAGE_DATA;
+  if(this->GlobalImage)
+    {
+    this->WholeExtent[0] = (*root)["WholeExtentXMin"]->GetValue<int>();
+    this->WholeExtent[1] = (*root)["WholeExtentXMax"]->GetValue<int>();
+    this->WholeExtent[2] = (*root)["WholeExtentYMin"]->GetValue<int>();
+    this->WholeExtent[3] = (*root)["WholeExtentYMax"]->GetValue<int>();
+    this->WholeExtent[4] = (*root)["WholeExtentZMin"]->GetValue<int>();
+    this->WholeExtent[5] = (*root)["WholeExtentZMax"]->GetValue<int>();
+    outInfo->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(),
+      this->WholeExtent, 6);
+    }
+
+  this->UpdateArraySelections();
+
   return true;
 }
 
+//----------------------------------------------------------------------------
+void vtkADIOSReader::UpdateArraySelections(void)
+{
+  const vtkADIOSDirTree *dDataSet = this->Tree.GetDir("/DataSet");
+  if(!dDataSet)
+    {
+    return;
+    }
+
+  // Everything under the attribute directories but the dimensions of the
+  // arrays is an array, so listing them doesn't require inquiring any
+  // variables.  Adding arrays found in the file isn't a user change to the
+  // selections, so it doesn't modify the reader.
+  vtkDataArraySelection *selections[3] = { this->PointDataArraySelection,
+    this->CellDataArraySelection, this->FieldDataArraySelection };
+  const char *attrNames[3] = { "PointData", "CellData", "FieldData" };
+  this->UpdatingArraySelections = true;
+  for(int a = 0; a < 3; ++a)
+    {
+    const vtkADIOSDirTree *d = dDataSet->GetDir(attrNames[a]);
+    if(!d)
+      {
+      continue;
+      }
+    for(VarMap::const_iterator v = d->Variables.begin();
+      v != d->Variables.end(); ++v)
+      {
+      if(!IsDimensionVariable(d->Variables, v->first))
+        {
+        selections[a]->AddArray(v->first.c_str());
+        }
+      }
+    }
+  this->UpdatingArraySelections = false;
+}
+
 //----------------------------------------------------------------------------
 bool vtkADIOSReader::RequestUpdateExtent(vtkInformation *req,
   vtkInformationVector **vtkNotUsed(input), vtkInformationVector *output)
@@ -226,6 +616,27 @@ bool vtkADIOSReader::RequestUpdateExtent(vtkInformation *req,
     }
   this->RequestStepIndex = idx->second;
 
+  // Restrict the extent to be read if one has been requested
+  this->HasRequestExtent = false;
+  if(this->GlobalImage &&
+     outInfo->Has(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT()))
+    {
+    outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(),
+      this->RequestExtent);
+    this->HasRequestExtent = true;
+    for(int i = 0; i < 6; i += 2)
+      {
+      this->RequestExtent[i] = std::max(this->RequestExtent[i],
+        this->WholeExtent[i]);
+      this->RequestExtent[i+1] = std::min(this->RequestExtent[i+1],
+        this->WholeExtent[i+1]);
+      if(this->RequestExtent[i] > this->RequestExtent[i+1])
+        {
+        this->HasRequestExtent = false;
+        }
+      }
+    }
+
   return true;
 }
 
@@ -237,47 +648,220 @@ bool vtkADIOSReader::RequestData(vtkInformation *req,
   vtkInformation* outInfo = outputVector->GetInformationObject(0);
   vtkMultiBlockDataSet* output = vtkMultiBlockDataSet::SafeDownCast(
     outInfo->Get(vtkDataObject::DATA_OBJECT()));
-
-  // Set up multi-piece for paraview 
-  vtkMultiPieceDataSet *outputPieces = vtkMultiPieceDataSet::New();
   output->SetNumberOfBlocks(1);
+
+  // Steps that have been read before with the same pieces and array
+  // selections come straight from the cache, then from a prefetch of the
+  // step, and only then from the file
+  std::string stepKey = this->GetStepCacheKey();
+  this->StepCache.SetMemoryLimit(this->CacheMemoryLimit);
+  vtkMultiPieceDataSet *cached = this->CacheMemoryLimit == 0 ? NULL :
+    vtkMultiPieceDataSet::SafeDownCast(this->StepCache.Find(stepKey));
+
+  bool readSuccess = true;
+  vtkSmartPointer<vtkMultiPieceDataSet> outputPieces;
+  if(cached)
+    {
+    outputPieces.TakeReference(ShallowCopyPieces(cached));
+    }
+  else
+    {
+    outputPieces = this->CompletePrefetch(stepKey);
+    if(!outputPieces)
+      {
+      // Set up multi-piece for paraview
+      outputPieces.TakeReference(vtkMultiPieceDataSet::New());
+      readSuccess = this->ReadStep(outputPieces);
+      }
+
+    if(readSuccess && this->CacheMemoryLimit > 0)
+      {
+      unsigned long size = 0;
+      vtkMultiPieceDataSet *copy = ShallowCopyPieces(outputPieces, &size);
+      this->StepCache.Insert(stepKey, copy, size);
+      copy->Delete();
+      }
+    }
   output->SetBlock(0, outputPieces);
 
+  // Start reading the step most likely to be requested next
+  if(this->Prefetch && readSuccess)
+    {
+    this->PrefetchStep();
+    }
+  this->LastStepIndex = this->RequestStepIndex;
+
+  return readSuccess;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::PrefetchStep(void)
+{
+  // Follow the direction the time steps are being played in
+  int direction = this->RequestStepIndex < this->LastStepIndex ? -1 : 1;
+  int nextStep = this->RequestStepIndex + direction;
+  if(nextStep < 0 || nextStep >= static_cast<int>(this->TimeSteps.size()) ||
+    !ADIOSReader::SupportsBackgroundReads())
+    {
+    return;
+    }
+
+  int step = this->RequestStepIndex;
+  this->RequestStepIndex = nextStep;
+  std::string stepKey = this->GetStepCacheKey();
+
+  bool pending = this->PrefetchPieces && stepKey == this->PrefetchKey;
+  bool cached = this->CacheMemoryLimit > 0 && this->StepCache.Find(stepKey);
+  if(!pending)
+    {
+    this->CompletePrefetch(std::string());
+    }
+  if(!pending && !cached)
+    {
+    vtkMultiPieceDataSet *pieces = vtkMultiPieceDataSet::New();
+    this->Prefetching = true;
+    bool readSuccess = this->ReadStep(pieces);
+    this->Prefetching = false;
+    if(readSuccess)
+      {
+      this->PrefetchPieces = pieces;
+      this->PrefetchKey = stepKey;
+      }
+    else
+      {
+      // Nothing may still be reading into the staging pieces once they're
+      // released, and nothing left of them may be finished with a later step
+      try
+        {
+        this->Reader->ReadArrays();
+        }
+      catch(const std::runtime_error&)
+        {
+        }
+      this->DiscardReads();
+      }
+    pieces->Delete();
+    }
+
+  this->RequestStepIndex = step;
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkMultiPieceDataSet> vtkADIOSReader::CompletePrefetch(
+  const std::string& stepKey)
+{
+  this->WaitForPrefetch();
+  vtkSmartPointer<vtkMultiPieceDataSet> pieces = this->PrefetchPieces;
+  this->PrefetchPieces = NULL;
+  return pieces && stepKey == this->PrefetchKey ? pieces :
+    vtkSmartPointer<vtkMultiPieceDataSet>();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::WaitForPrefetch(void)
+{
+  if(!this->PrefetchPieces || !this->Reader->HasPendingReads())
+    {
+    return;
+    }
+
+  try
+    {
+    this->Reader->WaitForReads();
+    this->FinishReads();
+    }
+  catch(const std::runtime_error &e)
+    {
+    vtkErrorMacro(<< "Prefetch: " << e.what());
+    this->DiscardReads();
+    this->PrefetchPieces = NULL;
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkADIOSReader::ReadStep(vtkMultiPieceDataSet *outputPieces)
+{
+  this->ReadStepIndex = this->RequestStepIndex;
+
   // Make sure the multi-piece has the "global view"
   outputPieces->SetNumberOfPieces(
     std::max(this->NumberOfPieces, this->RequestNumberOfPieces));
 
-  // Cut out early if there's too many request pieces
-  if(this->RequestPiece >= this->NumberOfPieces)
+  // Sub-extent requests read a single image regardless of how the data was
+  // originally decomposed
+  if(this->HasRequestExtent)
+    {
+    // Field data is not global so take it from the first block
+    this->ReadBlock = 0;
+    try
+      {
+      vtkImageData *image = this->ReadGlobalImage(this->Tree.GetDir("/"),
+        this->RequestExtent);
+      outputPieces->SetPiece(this->RequestPiece, image);
+      image->Delete();
+      this->WaitForReads();
+      }
+    catch(const std::runtime_error &e)
+      {
+      vtkErrorMacro(<< "Extent read: " << e.what());
+      return false;
+      }
+    return true;
+    }
+
+  // Each process wrote one block per step; partition this step's blocks
+  // into contiguous ranges of roughly equal size across the readers
+  const vtkADIOSDirTree *root = this->Tree.GetDir("/");
+  const ADIOSVarInfo *vType = (*root)["DataObjectType"];
+  if(!vType)
     {
-    return true;
+    vtkErrorMacro(<< "Missing DataObjectType");
+    return false;
     }
 
-  // Determine the range of blocks to be read
+  // Blocks culled by the value range are left out of the partitioning so
+  // the remaining ones are balanced across the readers
   int blockStart, blockEnd;
-  int blocksPerProc = this->NumberOfPieces > this->RequestNumberOfPieces ?
-    this->NumberOfPieces / this->RequestNumberOfPieces : 1;
-  int blocksLeftOver = this->NumberOfPieces % blocksPerProc;
-  if(this->RequestPiece < blocksLeftOver)
+  std::vector<bool> culled;
+  try
     {
-    blockStart = (blocksPerProc + 1) * this->RequestPiece;
-    blockEnd = blockStart + blocksPerProc;
+    std::vector<double> blockSizes(
+      vType->GetNumBlocks(this->RequestStepIndex), 0.0);
+    this->GetBlockSizes(root, blockSizes);
+    culled.resize(blockSizes.size(), false);
+    const vtkADIOSDirTree *dataSet = root->GetDir("DataSet");
+    for(size_t b = 0; b < blockSizes.size(); ++b)
+      {
+      if(!this->BlockIntersectsValueRange(dataSet, static_cast<int>(b)))
+        {
+        culled[b] = true;
+        blockSizes[b] = 0.0;
+        }
+      }
+    PartitionBlocks(blockSizes, this->RequestNumberOfPieces,
+      this->RequestPiece, blockStart, blockEnd);
     }
-  else
+  catch(const std::runtime_error &e)
     {
-    blockStart = blocksPerProc * this->RequestPiece + blocksLeftOver;
-    blockEnd = blockStart + blocksPerProc-1;
+    vtkErrorMacro(<< "Block partitioning: " << e.what());
+    return false;
     }
 
   // Loop through the assigned blocks
   bool readSuccess = true;
-  for(int blockId = blockStart; blockId <= blockEnd; ++blockId)
+  for(int blockId = blockStart; blockId < blockEnd; ++blockId)
     {
+    if(culled[blockId])
+      {
+      continue;
+      }
+    this->ReadBlock = blockId;
+
     vtkDataObject *block;
     try
       {
-      int objType = (*this->Tree.GetDir("/"))["vtkDataObjectType"]
-        ->GetValue<vtkTypeUInt8>();
+      int objType = vType->GetValue<vtkTypeUInt8>(this->RequestStepIndex,
+        blockId);
       switch(objType)
         {
         case VTK_IMAGE_DATA:
@@ -295,16 +879,135 @@ bool vtkADIOSReader::RequestData(vtkInformation *req,
     catch(const std::runtime_error &e)
       {
       vtkErrorMacro(<< "Piece " << blockId << ": " << e.what());
-      readSuccess = true;
+      readSuccess = false;
       continue;
       }
     outputPieces->SetPiece(blockId, block);
+    block->Delete();
     }
 
   // After all blocks have been scheduled, wait for the reads to process
   this->WaitForReads();
 
-  return true;
+  // Geometry from a failed read can't be shared with later steps
+  if(!readSuccess)
+    {
+    this->Geometry.clear();
+    }
+
+  return readSuccess;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkADIOSReader::GetStepCacheKey(void)
+{
+  std::ostringstream key;
+  key << this->RequestStepIndex << ':' << this->RequestPiece << '/'
+      << this->RequestNumberOfPieces;
+  if(this->HasRequestExtent)
+    {
+    key << ':' << this->RequestExtent[0];
+    for(int i = 1; i < 6; ++i)
+      {
+      key << ',' << this->RequestExtent[i];
+      }
+    }
+
+  // Length prefixed so that no array name can be mistaken for a delimiter
+  vtkDataArraySelection *selections[3] = { this->PointDataArraySelection,
+    this->CellDataArraySelection, this->FieldDataArraySelection };
+  for(int a = 0; a < 3; ++a)
+    {
+    key << '|';
+    for(int i = 0; i < selections[a]->GetNumberOfArrays(); ++i)
+      {
+      if(selections[a]->GetArraySetting(i))
+        {
+        std::string name = selections[a]->GetArrayName(i);
+        key << name.size() << ':' << name;
+        }
+      }
+    }
+
+  // Culling by value range changes which blocks are read
+  if(this->HasValueRange)
+    {
+    key.precision(17);
+    key << "|" << this->ValueRangeArray.size() << ':' << this->ValueRangeArray
+        << '[' << this->ValueRange[0] << ',' << this->ValueRange[1] << ']';
+    }
+  return key.str();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::GetBlockSizes(const vtkADIOSDirTree *dir,
+  std::vector<double>& sizes)
+{
+  // Only the variables that will be read are inquired: the geometry arrays
+  // and the selected attribute arrays
+  std::vector<const ADIOSVarInfo*> vars;
+  const char *geometry[3] = { "Points", "CellTypes", "CellLocations" };
+  for(int i = 0; i < 3; ++i)
+    {
+    vars.push_back((*dir)[geometry[i]]);
+    }
+  const char *cells[5] = { "Cells", "Verticies", "Lines", "Polygons",
+    "Strips" };
+  for(int i = 0; i < 5; ++i)
+    {
+    const vtkADIOSDirTree *d = dir->GetDir(cells[i]);
+    if(d)
+      {
+      vars.push_back((*d)["IndexArray"]);
+      vars.push_back((*d)["Connectivity"]);
+      }
+    }
+  const ReadPlan &plan = this->GetReadPlan(dir->GetDir("DataSet"));
+  for(int a = 0; a < 3; ++a)
+    {
+    for(size_t i = 0; i < plan.Arrays[a].size(); ++i)
+      {
+      vars.push_back(plan.Arrays[a][i].Info);
+      }
+    }
+
+  for(size_t i = 0; i < vars.size(); ++i)
+    {
+    const ADIOSVarInfo *v = vars[i];
+    if(!v || v->IsScalar())
+      {
+      continue;
+      }
+    size_t numBlocks = std::min(sizes.size(),
+      v->GetNumBlocks(this->RequestStepIndex));
+    for(size_t b = 0; b < numBlocks; ++b)
+      {
+      sizes[b] += v->GetBlockSize(this->RequestStepIndex, b);
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSReader::GetGeometryStep(const vtkADIOSDirTree *dir,
+  const std::string& name)
+{
+  const ADIOSVarInfo *v = (*dir)[name];
+  return v ? v->GetValue<int>(this->RequestStepIndex, this->ReadBlock) :
+    this->RequestStepIndex;
+}
+
+//----------------------------------------------------------------------------
+std::vector<vtkSmartPointer<vtkObject> >& vtkADIOSReader::GetGeometry(
+  const std::string& name)
+{
+  GeometryEntry &entry =
+    this->Geometry[std::make_pair(name, this->ReadBlock)];
+  if(entry.Step != this->ReadStepIndex)
+    {
+    entry.Step = this->ReadStepIndex;
+    entry.Objects.clear();
+    }
+  return entry.Objects;
 }
 
 //----------------------------------------------------------------------------
@@ -312,10 +1015,47 @@ void vtkADIOSReader::PrintSelf(std::ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
   os << indent << "FileName: " << this->FileName << std::endl;
+  os << indent << "SynchronizationPolicy: "
+     << ADIOS::ToString(this->SynchronizationPolicy) << std::endl;
+  os << indent << "BroadcastMetadata: " << this->BroadcastMetadata
+     << std::endl;
+  os << indent << "MetadataIndex: " << this->MetadataIndex << std::endl;
+  if(this->HasValueRange)
+    {
+    os << indent << "ValueRange: " << this->ValueRangeArray << " ["
+       << this->ValueRange[0] << ", " << this->ValueRange[1] << "]"
+       << std::endl;
+    }
+  else
+    {
+    os << indent << "ValueRange: (none)" << std::endl;
+    }
+  os << indent << "CacheMemoryLimit: " << this->CacheMemoryLimit
+     << std::endl;
+  os << indent << "Prefetch: " << this->Prefetch << std::endl;
+  os << indent << "PointDataArraySelection: "
+     << this->PointDataArraySelection << std::endl;
+  os << indent << "CellDataArraySelection: "
+     << this->CellDataArraySelection << std::endl;
+  os << indent << "FieldDataArraySelection: "
+     << this->FieldDataArraySelection << std::endl;
   os << indent << "Tree: " << std::endl;
   this->Tree.PrintSelf(os, indent.GetNextIndent());
 }
 
+//----------------------------------------------------------------------------
+void vtkADIOSReader::PrintSynchronizationReport(std::ostream& os)
+{
+  if(!this->Controller)
+    {
+    return;
+    }
+
+  ADIOSUtilities::PrintSyncReport(this->Controller,
+    ADIOSReader::GetSyncWaitTime(), "reader synchronization (" +
+    ADIOS::ToString(this->SynchronizationPolicy) + ")", os);
+}
+
 //----------------------------------------------------------------------------
 bool vtkADIOSReader::OpenAndReadMetadata(void)
 {
@@ -326,8 +1066,15 @@ bool vtkADIOSReader::OpenAndReadMetadata(void)
 
   try
     {
+    this->Reader->SetBroadcastMetadata(this->BroadcastMetadata);
+    this->Reader->SetMetadataIndex(this->MetadataIndex);
     this->Reader->OpenFile(this->FileName);
     this->Tree.BuildDirTree(*this->Reader);
+    this->Geometry.clear();
+    this->ReadPlans.clear();
+
+    // Cached steps may have been read from a different file
+    this->StepCache.Clear();
     }
   catch(const std::runtime_error&)
     {
@@ -339,7 +1086,174 @@ bool vtkADIOSReader::OpenAndReadMetadata(void)
 //----------------------------------------------------------------------------
 void vtkADIOSReader::WaitForReads(void)
 {
-  this->Reader->ReadArrays();
+  // Prefetched reads complete in the background
+  this->Reader->ReadArrays(!this->Prefetching);
+  if(!this->Prefetching)
+    {
+    this->FinishReads();
+    }
+}
+
+//----------------------------------------------------------------------------
+// Read a little endian base 128 varint, advancing pos past it
+static vtkTypeUInt64 UnpackVarint(const unsigned char*& pos,
+  const unsigned char* end)
+{
+  vtkTypeUInt64 v = 0;
+  for(int shift = 0; pos != end; shift += 7)
+    {
+    unsigned char b = *pos++;
+    v |= static_cast<vtkTypeUInt64>(b & 0x7F) << shift;
+    if(!(b & 0x80))
+      {
+      return v;
+      }
+    }
+  throw std::runtime_error("Truncated cell connectivity");
+}
+
+//----------------------------------------------------------------------------
+// Rebuild the legacy (npts, id, id, ...) connectivity of cells from its
+// encoded form
+static void DecodeCells(vtkDataArray *stored, int encoding,
+  vtkIdType numCells, int cellSize, vtkCellArray *cells)
+{
+  size_t n = static_cast<size_t>(stored->GetNumberOfTuples()) *
+    stored->GetNumberOfComponents();
+  std::vector<vtkIdType> ids;
+  if(cellSize > 0)
+    {
+    ids.reserve(numCells * (cellSize+1));
+    }
+
+  if(encoding == ADIOS::CellEncoding_Delta)
+    {
+    const unsigned char *pos =
+      static_cast<const unsigned char*>(stored->GetVoidPointer(0));
+    const unsigned char *end = pos + n;
+    vtkTypeInt64 prev = 0;
+    for(vtkIdType c = 0; c < numCells; ++c)
+      {
+      vtkIdType npts = cellSize > 0 ? cellSize :
+        static_cast<vtkIdType>(UnpackVarint(pos, end));
+      ids.push_back(npts);
+      for(vtkIdType j = 0; j < npts; ++j)
+        {
+        vtkTypeUInt64 v = UnpackVarint(pos, end);
+        prev += static_cast<vtkTypeInt64>(v >> 1) ^
+          -static_cast<vtkTypeInt64>(v & 1);
+        ids.push_back(static_cast<vtkIdType>(prev));
+        }
+      }
+    }
+  else
+    {
+    std::vector<vtkIdType> values(n);
+    if(n > 0)
+      {
+      ADIOSUtilities::ConvertValues(stored->GetVoidPointer(0),
+        stored->GetDataType(), &values[0], VTK_ID_TYPE, n);
+      }
+    if(cellSize > 0)
+      {
+      if(n != static_cast<size_t>(numCells) * cellSize)
+        {
+        throw std::runtime_error("Mismatched cell connectivity size");
+        }
+      for(size_t i = 0; i < n; i += cellSize)
+        {
+        ids.push_back(cellSize);
+        ids.insert(ids.end(), values.begin()+i, values.begin()+i+cellSize);
+        }
+      }
+    else
+      {
+      ids.swap(values);
+      }
+    }
+
+  vtkIdTypeArray *ia = vtkIdTypeArray::New();
+  ia->SetNumberOfTuples(ids.size());
+  if(!ids.empty())
+    {
+    std::copy(ids.begin(), ids.end(), ia->GetPointer(0));
+    }
+  cells->SetCells(numCells, ia);
+  ia->Delete();
+}
+
+//----------------------------------------------------------------------------
+// Fill in the location of each cell in the connectivity, directly when every
+// cell has cellSize points and otherwise with a prefix sum over the cell sizes
+static void BuildCellLocations(vtkCellArray *cells, vtkIdTypeArray *locs,
+  int cellSize)
+{
+  const vtkIdType *ids = cells->GetData()->GetPointer(0);
+  vtkIdType len = cells->GetNumberOfConnectivityEntries();
+  vtkIdType numCells = locs->GetNumberOfTuples();
+  vtkIdType *loc = locs->GetPointer(0);
+  if(cellSize > 0)
+    {
+    if(numCells * (cellSize + 1) > len)
+      {
+      throw std::runtime_error("Cell connectivity shorter than the cells");
+      }
+    for(vtkIdType i = 0; i < numCells; ++i)
+      {
+      loc[i] = i * (cellSize + 1);
+      }
+    return;
+    }
+  vtkIdType offset = 0;
+  for(vtkIdType i = 0; i < numCells; ++i)
+    {
+    if(offset >= len)
+      {
+      throw std::runtime_error("Cell connectivity shorter than the cells");
+      }
+    loc[i] = offset;
+    offset += ids[offset] + 1;
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::FinishReads(void)
+{
+  for(size_t i = 0; i < this->Conversions.size(); ++i)
+    {
+    vtkDataArray *stored = this->Conversions[i].first;
+    vtkDataArray *data = this->Conversions[i].second;
+    ADIOSUtilities::ConvertValues(stored->GetVoidPointer(0),
+      stored->GetDataType(), data->GetVoidPointer(0), data->GetDataType(),
+      static_cast<size_t>(data->GetNumberOfTuples()) *
+      data->GetNumberOfComponents());
+    }
+  this->Conversions.clear();
+
+  for(size_t i = 0; i < this->Decodings.size(); ++i)
+    {
+    const CellDecoding &d = this->Decodings[i];
+    DecodeCells(d.Stored, d.Encoding, d.NumberOfCells, d.CellSize, d.Cells);
+    }
+  this->Decodings.clear();
+
+  for(size_t i = 0; i < this->Locations.size(); ++i)
+    {
+    const CellLocations &l = this->Locations[i];
+    BuildCellLocations(l.Cells, l.Locations, l.CellSize);
+    }
+  this->Locations.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::DiscardReads(void)
+{
+  this->Conversions.clear();
+  this->Decodings.clear();
+  this->Locations.clear();
+
+  // Geometry shared with later steps may be among the unfinished reads
+  this->Geometry.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -397,108 +1311,181 @@ vtkUnstructuredGrid* vtkADIOSReader::ReadObject<vtkUnstructuredGrid>(
 void vtkADIOSReader::ReadObject(const ADIOSVarInfo* info,
   vtkDataArray* data)
 {
+  // Use the dims of the block being read since they may vary between steps
   std::vector<size_t> dims;
-  info->GetDims(dims);
-  if(dims.size() < 2)
+  info->GetDims(dims, this->ReadStepIndex, this->ReadBlock);
+  size_t numComponents, numTuples;
+  if(info->IsGlobal())
     {
-    throw std::runtime_error("Not enough dims specified for data array");
+    // Global image arrays are z x y x x with an optional trailing component
+    if(dims.size() < 3)
+      {
+      throw std::runtime_error("Not enough dims specified for global array");
+      }
+    numComponents = dims.size() > 3 ? dims[3] : 1;
+    numTuples = dims[0] * dims[1] * dims[2];
+    }
+  else
+    {
+    if(dims.size() < 2)
+      {
+      throw std::runtime_error("Not enough dims specified for data array");
+      }
+    numComponents = dims[0];
+    numTuples = dims[1];
     }
 
-  data->SetNumberOfComponents(dims[0]);
-  data->SetNumberOfTuples(dims[1]);
+  data->SetNumberOfComponents(numComponents);
+  data->SetNumberOfTuples(numTuples);
 
   // Only queue the read if there's data to be read
-  if(dims[0] != 0 && dims[1] != 0)
+  if(numComponents == 0 || numTuples == 0)
     {
-    this->Reader->ScheduleReadArray(info->GetId(), data->GetVoidPointer(0),
-      this->RequestStepIndex);
+    return;
+    }
+
+  // Arrays stored in a different type than requested, e.g. narrowed ids,
+  // are read as stored and converted once the read completes
+  vtkDataArray *target = data;
+  if(ADIOSUtilities::TypeVTKToADIOS(data->GetDataType()) !=
+    ADIOSUtilities::TypeVTKToADIOS(info->GetType()))
+    {
+    data = vtkDataArray::CreateDataArray(info->GetType());
+    data->SetNumberOfComponents(numComponents);
+    data->SetNumberOfTuples(numTuples);
+    this->Conversions.push_back(std::make_pair(
+      vtkSmartPointer<vtkDataArray>(data),
+      vtkSmartPointer<vtkDataArray>(target)));
+    data->Delete();
     }
+  this->Reader->ScheduleReadArray(info->GetId(), data->GetVoidPointer(0),
+    this->ReadStepIndex, this->ReadBlock);
 }
 
 //----------------------------------------------------------------------------
 void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
   vtkCellArray* data)
 {
-  data->SetNumberOfCells((*subDir)["NumberOfCells"]->GetValue<vtkIdType>());
-  this->ReadObject((*subDir)["Ia"], data->GetData());
+  vtkIdType numCells = (*subDir)["NumberOfCells"]->GetValue<vtkIdType>(
+    this->ReadStepIndex, this->ReadBlock);
+  data->SetNumberOfCells(numCells);
+  const ADIOSVarInfo *v = (*subDir)["Connectivity"];
+  if(!v)
+    {
+    this->ReadObject((*subDir)["IndexArray"], data->GetData());
+    return;
+    }
+
+  // Encoded connectivity is read as stored and decoded once read
+  CellDecoding d;
+  d.Stored.TakeReference(vtkDataArray::CreateDataArray(v->GetType()));
+  d.Cells = data;
+  d.Encoding = (*subDir)["CellEncoding"]->GetValue<vtkTypeUInt8>(
+    this->ReadStepIndex, this->ReadBlock);
+  d.NumberOfCells = numCells;
+  d.CellSize = (*subDir)["CellSize"]->GetValue<int>(this->ReadStepIndex,
+    this->ReadBlock);
+  this->ReadObject(v, d.Stored);
+  this->Decodings.push_back(d);
 }
 
 //----------------------------------------------------------------------------
-void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
+const vtkADIOSReader::ReadPlan& vtkADIOSReader::GetReadPlan(
+  const vtkADIOSDirTree *dir)
+{
+  std::map<const vtkADIOSDirTree*, ReadPlan>::iterator p =
+    this->ReadPlans.find(dir);
+  if(p != this->ReadPlans.end())
+    {
+    return p->second;
+    }
+
+  ReadPlan &plan = this->ReadPlans[dir];
+  if(!dir)
+    {
+    return plan;
+    }
+
+  const char *attrNames[3] = { "FieldData", "CellData", "PointData" };
+  vtkDataArraySelection *selections[3] = { this->FieldDataArraySelection,
+    this->CellDataArraySelection, this->PointDataArraySelection };
+  for(int a = 0; a < 3; ++a)
+    {
+    const vtkADIOSDirTree *d = dir->GetDir(attrNames[a]);
+    if(!d)
+      {
+      continue;
+      }
+    for(VarMap::const_iterator v = d->Variables.begin();
+      v != d->Variables.end(); ++v)
+      {
+      // Check the selection first so unselected arrays are never inquired
+      if(!selections[a]->ArrayIsEnabled(v->first.c_str()) ||
+        v->second->IsScalar())
+        {
+        continue;
+        }
+      ReadPlanEntry e;
+      e.Name = v->first;
+      e.Info = v->second;
+      plan.Arrays[a].push_back(e);
+      }
+    }
+  return plan;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::ReadObject(const std::vector<ReadPlanEntry>& arrays,
   vtkFieldData* data)
 {
-  for(std::map<std::string, const ADIOSVarInfo*>::const_iterator a =
-    subDir->Arrays.begin(); a != subDir->Arrays.end(); ++a)
+  data->AllocateArrays(static_cast<int>(arrays.size()));
+  for(std::vector<ReadPlanEntry>::const_iterator a = arrays.begin();
+    a != arrays.end(); ++a)
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(a->second->GetType());
+    vtkDataArray *da = vtkDataArray::CreateDataArray(a->Info->GetType());
 
-    da->SetName(a->first.c_str());
-    this->ReadObject(a->second, da);
+    da->SetName(a->Name.c_str());
+    this->ReadObject(a->Info, da);
     data->AddArray(da);
+    da->Delete();
     }
 }
 
 //----------------------------------------------------------------------------
-void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
+void vtkADIOSReader::ReadObject(const std::vector<ReadPlanEntry>& arrays,
   vtkDataSetAttributes* data)
 {
-  const ADIOSVarInfo *v;
+  this->ReadObject(arrays, static_cast<vtkFieldData*>(data));
 
-  if(v = (*subDir)["Scalars_"])
+  // Arrays with the reserved attribute names become the active attributes
+  vtkDataArray *da;
+  if((da = data->GetArray("Scalars_")))
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(v->GetType());
-    da->SetName("Scalars_");
-    this->ReadObject(v, da);
     data->SetScalars(da);
-    da->UnRegister(0);
     }
-  if(v = (*subDir)["Vectors_"])
+  if((da = data->GetArray("Vectors_")))
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(v->GetType());
-    da->SetName("Vectors_");
-    this->ReadObject(v, da);
     data->SetVectors(da);
-    da->UnRegister(0);
     }
-  if(v = (*subDir)["Normals_"])
+  if((da = data->GetArray("Normals_")))
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(v->GetType());
-    da->SetName("Normals_");
-    this->ReadObject(v, da);
     data->SetNormals(da);
-    da->UnRegister(0);
     }
-  if(v = (*subDir)["TCoords_"])
+  if((da = data->GetArray("TCoords_")))
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(v->GetType());
-    da->SetName("TCoords_");
-    this->ReadObject(v, da);
     data->SetTCoords(da);
-    da->UnRegister(0);
     }
-  if(v = (*subDir)["Tensors_"])
+  if((da = data->GetArray("Tensors_")))
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(v->GetType());
-    da->SetName("Tensors_");
-    this->ReadObject(v, da);
     data->SetTensors(da);
-    da->UnRegister(0);
     }
-  if(v = (*subDir)["GlobalIds_"])
+  if((da = data->GetArray("GlobalIds_")))
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(v->GetType());
-    da->SetName("GlobalIds_");
-    this->ReadObject(v, da);
     data->SetGlobalIds(da);
-    da->UnRegister(0);
     }
-  if(v = (*subDir)["PedigreeIds_"])
+  if((da = data->GetArray("PedigreeIds_")))
     {
-    vtkDataArray *da = vtkDataArray::CreateDataArray(v->GetType());
-    da->SetName("PedigreeIds_");
-    this->ReadObject(v, da);
     data->SetPedigreeIds(da);
-    da->UnRegister(0);
     }
 }
 
@@ -506,43 +1493,34 @@ void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
 void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
   vtkDataSet* data)
 {
-  const vtkADIOSDirTree *d;
-
-  if(d = subDir->GetDir("FieldData"))
-    {
-    this->ReadObject(d, data->GetFieldData());
-    }
-  if(d = subDir->GetDir("CellData"))
-    {
-    this->ReadObject(d, data->GetCellData());
-    }
-  if(d = subDir->GetDir("PointData"))
-    {
-    this->ReadObject(d, data->GetPointData());
-    }
+  const ReadPlan &plan = this->GetReadPlan(subDir);
+  this->ReadObject(plan.Arrays[PLAN_FIELD_DATA], data->GetFieldData());
+  this->ReadObject(plan.Arrays[PLAN_CELL_DATA], data->GetCellData());
+  this->ReadObject(plan.Arrays[PLAN_POINT_DATA], data->GetPointData());
 }
 
 //----------------------------------------------------------------------------
 void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
   vtkImageData* data)
 {
+  int step = this->RequestStepIndex, block = this->ReadBlock;
   data->SetOrigin(
-    (*subDir)["OriginX"]->GetValue<double>(),
-    (*subDir)["OriginY"]->GetValue<double>(),
-    (*subDir)["OriginZ"]->GetValue<double>());
+    (*subDir)["OriginX"]->GetValue<double>(step, block),
+    (*subDir)["OriginY"]->GetValue<double>(step, block),
+    (*subDir)["OriginZ"]->GetValue<double>(step, block));
   data->SetSpacing(
-    (*subDir)["SpacingX"]->GetValue<double>(),
-    (*subDir)["SpacingY"]->GetValue<double>(),
-    (*subDir)["SpacingZ"]->GetValue<double>());
+    (*subDir)["SpacingX"]->GetValue<double>(step, block),
+    (*subDir)["SpacingY"]->GetValue<double>(step, block),
+    (*subDir)["SpacingZ"]->GetValue<double>(step, block));
   data->SetExtent(
-    (*subDir)["ExtentXMin"]->GetValue<int>(),
-    (*subDir)["ExtentXMax"]->GetValue<int>(),
-    (*subDir)["ExtentYMin"]->GetValue<int>(),
-    (*subDir)["ExtentYMax"]->GetValue<int>(),
-    (*subDir)["ExtentZMin"]->GetValue<int>(),
-    (*subDir)["ExtentZMax"]->GetValue<int>());
-
-  this->ReadObject(subDir->GetDir("vtkDataSet"),
+    (*subDir)["ExtentXMin"]->GetValue<int>(step, block),
+    (*subDir)["ExtentXMax"]->GetValue<int>(step, block),
+    (*subDir)["ExtentYMin"]->GetValue<int>(step, block),
+    (*subDir)["ExtentYMax"]->GetValue<int>(step, block),
+    (*subDir)["ExtentZMin"]->GetValue<int>(step, block),
+    (*subDir)["ExtentZMax"]->GetValue<int>(step, block));
+
+  this->ReadObject(subDir->GetDir("DataSet"),
     static_cast<vtkDataSet*>(data));
 }
 
@@ -550,41 +1528,62 @@ void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
 void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
   vtkPolyData* data)
 {
+  // Geometry is shared with any other step it was read for
   const ADIOSVarInfo *v;
+  this->ReadStepIndex = this->GetGeometryStep(subDir, "PointsStep");
   if(v = (*subDir)["Points"])
     {
-    vtkPoints *p = vtkPoints::New();
-    this->ReadObject(v, p->GetData());
-    data->SetPoints(p);
+    std::vector<vtkSmartPointer<vtkObject> > &points =
+      this->GetGeometry("Points");
+    if(points.empty())
+      {
+      vtkSmartPointer<vtkPoints> p = vtkSmartPointer<vtkPoints>::New();
+      p->SetDataType(v->GetType());
+      this->ReadObject(v, p->GetData());
+      points.push_back(p);
+      }
+    data->SetPoints(vtkPoints::SafeDownCast(points[0]));
     }
 
-  const vtkADIOSDirTree *d;
-  if(d = subDir->GetDir("Verticies"))
+  this->ReadStepIndex = this->GetGeometryStep(subDir, "CellsStep");
+  std::vector<vtkSmartPointer<vtkObject> > &cells =
+    this->GetGeometry("PolyCells");
+  if(cells.empty())
+    {
+    const char *names[4] = { "Verticies", "Lines", "Polygons", "Strips" };
+    std::vector<vtkSmartPointer<vtkObject> > read(4);
+    for(int i = 0; i < 4; ++i)
+      {
+      const vtkADIOSDirTree *d;
+      if(d = subDir->GetDir(names[i]))
+        {
+        vtkCellArray *ca = vtkCellArray::New();
+        read[i] = ca;
+        ca->Delete();
+        this->ReadObject(d, ca);
+        }
+      }
+    cells.swap(read);
+    }
+  if(cells[0])
     {
-    vtkCellArray *cells = vtkCellArray::New();
-    this->ReadObject(d, cells);
-    data->SetVerts(cells);
+    data->SetVerts(vtkCellArray::SafeDownCast(cells[0]));
     }
-  if(d = subDir->GetDir("Lines"))
+  if(cells[1])
     {
-    vtkCellArray *cells = vtkCellArray::New();
-    this->ReadObject(d, cells);
-    data->SetLines(cells);
+    data->SetLines(vtkCellArray::SafeDownCast(cells[1]));
     }
-  if(d = subDir->GetDir("Polygons"))
+  if(cells[2])
     {
-    vtkCellArray *cells = vtkCellArray::New();
-    this->ReadObject(d, cells);
-    data->SetPolys(cells);
+    data->SetPolys(vtkCellArray::SafeDownCast(cells[2]));
     }
-  if(d = subDir->GetDir("Strips"))
+  if(cells[3])
     {
-    vtkCellArray *cells = vtkCellArray::New();
-    this->ReadObject(d, cells);
-    data->SetStrips(cells);
+    data->SetStrips(vtkCellArray::SafeDownCast(cells[3]));
     }
+  this->ReadStepIndex = this->RequestStepIndex;
 
-  this->ReadObject(subDir->GetDir("vtkDataSet"),
+  this->ReadObject(subDir->GetDir("DataSet"),
     static_cast<vtkDataSet*>(data));
 }
 
@@ -592,32 +1591,185 @@ void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
 void vtkADIOSReader::ReadObject(const vtkADIOSDirTree *subDir,
   vtkUnstructuredGrid* data)
 {
+  // Geometry is shared with any other step it was read for
   const ADIOSVarInfo *v;
+  this->ReadStepIndex = this->GetGeometryStep(subDir, "PointsStep");
   if(v = (*subDir)["Points"])
     {
-    vtkPoints *p = vtkPoints::New();
-    this->ReadObject(v, p->GetData());
-    data->SetPoints(p);
+    std::vector<vtkSmartPointer<vtkObject> > &points =
+      this->GetGeometry("Points");
+    if(points.empty())
+      {
+      vtkSmartPointer<vtkPoints> p = vtkSmartPointer<vtkPoints>::New();
+      p->SetDataType(v->GetType());
+      this->ReadObject(v, p->GetData());
+      points.push_back(p);
+      }
+    data->SetPoints(vtkPoints::SafeDownCast(points[0]));
     }
 
+  this->ReadStepIndex = this->GetGeometryStep(subDir, "CellsStep");
+  // Cell locations may have been omitted since they can be rebuilt
   const ADIOSVarInfo *vCta = (*subDir)["CellTypes"];
+  const ADIOSVarInfo *vCtype = (*subDir)["CellType"];
   const ADIOSVarInfo *vCla = (*subDir)["CellLocations"];
   const vtkADIOSDirTree *dCa = subDir->GetDir("Cells");
-  if(vCta && vCla && dCa)
+  if(vCta && dCa)
     {
-    vtkUnsignedCharArray *cta = vtkUnsignedCharArray::New();
-    vtkIdTypeArray *cla = vtkIdTypeArray::New();
-    vtkCellArray *ca = vtkCellArray::New();
-    this->ReadObject(vCta, cta);
-    this->ReadObject(vCla, cla);
-    this->ReadObject(dCa, ca);
-    data->SetCells(cta, cla, ca);
+    std::vector<vtkSmartPointer<vtkObject> > &cells =
+      this->GetGeometry("GridCells");
+    if(cells.empty())
+      {
+      // Only share the objects once they have all been scheduled for reading
+      std::vector<vtkSmartPointer<vtkObject> > read(3);
+      vtkUnsignedCharArray *cta = vtkUnsignedCharArray::New();
+      vtkIdTypeArray *cla = vtkIdTypeArray::New();
+      vtkCellArray *ca = vtkCellArray::New();
+      read[0] = cta;
+      read[1] = cla;
+      read[2] = ca;
+      cta->Delete();
+      cla->Delete();
+      ca->Delete();
+      this->ReadObject(dCa, ca);
+
+      // A grid of a single cell type only stores that type
+      unsigned char cellType = vCtype ?
+        vCtype->GetValue<vtkTypeUInt8>(this->ReadStepIndex, this->ReadBlock) :
+        static_cast<unsigned char>(VTK_EMPTY_CELL);
+      if(cellType != VTK_EMPTY_CELL)
+        {
+        cta->SetNumberOfTuples(ca->GetNumberOfCells());
+        std::fill(cta->GetPointer(0), cta->GetPointer(0) +
+          ca->GetNumberOfCells(), cellType);
+        }
+      else
+        {
+        this->ReadObject(vCta, cta);
+        }
+
+      if(vCla)
+        {
+        this->ReadObject(vCla, cla);
+        }
+      else
+        {
+        CellLocations l;
+        l.Cells = ca;
+        l.Locations = cla;
+        const ADIOSVarInfo *vSize = (*dCa)["CellSize"];
+        l.CellSize = vSize ? vSize->GetValue<int>(this->ReadStepIndex,
+          this->ReadBlock) : 0;
+        cla->SetNumberOfTuples(ca->GetNumberOfCells());
+        this->Locations.push_back(l);
+        }
+      cells.swap(read);
+      }
+    data->SetCells(vtkUnsignedCharArray::SafeDownCast(cells[0]),
+      vtkIdTypeArray::SafeDownCast(cells[1]),
+      vtkCellArray::SafeDownCast(cells[2]));
     }
+  this->ReadStepIndex = this->RequestStepIndex;
 
-  this->ReadObject(subDir->GetDir("vtkDataSet"),
+  this->ReadObject(subDir->GetDir("DataSet"),
     static_cast<vtkDataSet*>(data));
 }
 
+//----------------------------------------------------------------------------
+vtkImageData* vtkADIOSReader::ReadGlobalImage(const vtkADIOSDirTree *subDir,
+  const int extent[6])
+{
+  // The origin and spacing are the same in every block
+  int step = this->RequestStepIndex, block = 0;
+  vtkImageData *data = vtkImageData::New();
+  data->SetOrigin(
+    (*subDir)["OriginX"]->GetValue<double>(step, block),
+    (*subDir)["OriginY"]->GetValue<double>(step, block),
+    (*subDir)["OriginZ"]->GetValue<double>(step, block));
+  data->SetSpacing(
+    (*subDir)["SpacingX"]->GetValue<double>(step, block),
+    (*subDir)["SpacingY"]->GetValue<double>(step, block),
+    (*subDir)["SpacingZ"]->GetValue<double>(step, block));
+  data->SetExtent(const_cast<int*>(extent));
+
+  const vtkADIOSDirTree *dDataSet = subDir->GetDir("DataSet");
+  if(!dDataSet)
+    {
+    return data;
+    }
+
+  const ReadPlan &plan = this->GetReadPlan(dDataSet);
+  this->ReadObject(plan.Arrays[PLAN_FIELD_DATA], data->GetFieldData());
+
+  vtkFieldData *attrs[2] = { data->GetPointData(), data->GetCellData() };
+  const std::vector<ReadPlanEntry> *arrays[2] = {
+    &plan.Arrays[PLAN_POINT_DATA], &plan.Arrays[PLAN_CELL_DATA] };
+  for(int a = 0; a < 2; ++a)
+    {
+    attrs[a]->AllocateArrays(static_cast<int>(arrays[a]->size()));
+    for(std::vector<ReadPlanEntry>::const_iterator v = arrays[a]->begin();
+      v != arrays[a]->end(); ++v)
+      {
+      vtkDataArray *da = vtkDataArray::CreateDataArray(v->Info->GetType());
+      da->SetName(v->Name.c_str());
+      this->ReadGlobalArray(v->Info, extent, a == 1, da);
+      attrs[a]->AddArray(da);
+      da->Delete();
+      }
+    }
+
+  return data;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSReader::ReadGlobalArray(const ADIOSVarInfo* info,
+  const int extent[6], bool cellData, vtkDataArray* data)
+{
+  std::vector<size_t> globalDims;
+  info->GetDims(globalDims);
+  if(!info->IsGlobal() || globalDims.size() < 3)
+    {
+    throw std::runtime_error("Array " + info->GetName() +
+      " is not a global image array");
+    }
+
+  // Translate the extent into the z, y, x index space of the global array
+  std::vector<size_t> start, count;
+  size_t numTuples = 1;
+  for(int i = 2; i >= 0; --i)
+    {
+    size_t n = extent[2*i+1] - extent[2*i] + 1;
+    size_t offset = extent[2*i] - this->WholeExtent[2*i];
+    if(cellData)
+      {
+      n = n > 1 ? n-1 : 1;
+      if(offset + n > globalDims[2-i])
+        {
+        offset = globalDims[2-i] - n;
+        }
+      }
+    start.push_back(offset);
+    count.push_back(n);
+    numTuples *= n;
+    }
+
+  size_t numComponents = 1;
+  if(globalDims.size() > 3)
+    {
+    numComponents = globalDims[3];
+    start.push_back(0);
+    count.push_back(numComponents);
+    }
+
+  data->SetNumberOfComponents(numComponents);
+  data->SetNumberOfTuples(numTuples);
+  if(numTuples != 0 && numComponents != 0)
+    {
+    this->Reader->ScheduleReadArray(info->GetId(), data->GetVoidPointer(0),
+      this->RequestStepIndex, start, count);
+    }
+}
+
 //----------------------------------------------------------------------------
 //Cleanup
 #undef TEST_OBJECT_TYPE
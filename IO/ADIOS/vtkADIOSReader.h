@@ -29,19 +29,27 @@
 #include <vtkMPIController.h>
 
 #include "vtkIOADIOSModule.h" // For export macro
+#include "ADIOSDefs.h"
 #include "vtkADIOSDirTree.h"
+#include "vtkADIOSStepCache.h"
 
+class ADIOSAttribute;
 class ADIOSVarInfo;
 class ADIOSReader;
 
+class vtkCallbackCommand;
 class vtkDataArray;
+class vtkDataArraySelection;
 class vtkCellArray;
 class vtkFieldData;
 class vtkDataSetAttributes;
 class vtkDataObject;
 class vtkDataSet;
+class vtkIdTypeArray;
 class vtkImageData;
+class vtkMultiPieceDataSet;
 class vtkPolyData;
+class vtkUnstructuredGrid;
 
 //----------------------------------------------------------------------------
 
@@ -71,6 +79,105 @@ public:
   vtkSetMacro(ReadMethodArguments, const char *);  
   vtkGetMacro(ReadMethodArguments, const char *);  
   
+  // Description:
+  // Get/Set how ranks are synchronized when the file is closed: with a barrier
+  // (Barrier, default), not at all (None), or once at finalization
+  // (Deferred).
+  vtkSetMacro(SynchronizationPolicy, ADIOS::SyncPolicy)
+  vtkGetMacro(SynchronizationPolicy, ADIOS::SyncPolicy)
+
+  // Description:
+  // Get/Set whether only rank 0 inquires the file metadata on open and
+  // broadcasts it to the other ranks.  Every rank then holds the metadata
+  // of every variable.  Otherwise (default) each rank only inquires the
+  // variables it actually uses, when it first uses them.  If called, it
+  // must be called BEFORE the file is first opened.
+  vtkSetMacro(BroadcastMetadata, bool)
+  vtkGetMacro(BroadcastMetadata, bool)
+  vtkBooleanMacro(BroadcastMetadata, bool)
+
+  // Description:
+  // Get/Set whether the file metadata is cached in a sidecar index file next
+  // to it, <FileName>.vtkidx, to speed up re-opening large files.  A stale
+  // index is detected by the file's size and modification time and rebuilt.
+  // If called, it must be called BEFORE the file is first opened.
+  vtkSetMacro(MetadataIndex, bool)
+  vtkGetMacro(MetadataIndex, bool)
+  vtkBooleanMacro(MetadataIndex, bool)
+
+  // Description:
+  // Get/Set the memory budget in kibibytes for caching time steps that have
+  // been read.  Requesting a cached step again with the same pieces and
+  // array selections returns shallow copies instead of reading it from the
+  // file, and the least recently used steps are evicted to stay within the
+  // budget.  The default of 0 disables the cache.
+  vtkSetMacro(CacheMemoryLimit, unsigned long)
+  vtkGetMacro(CacheMemoryLimit, unsigned long)
+
+  // Description:
+  // Get/Set whether the step after the one just delivered (or before it
+  // when playing backwards) is read ahead on a worker thread, so that the
+  // next request finds it mostly read.  The worker is joined at the start
+  // of the next pipeline request.  Since the read methods may use MPI,
+  // prefetching only happens if MPI was initialized with
+  // MPI_THREAD_MULTIPLE.  Off by default.
+  vtkSetMacro(Prefetch, bool)
+  vtkGetMacro(Prefetch, bool)
+  vtkBooleanMacro(Prefetch, bool)
+
+  // Description:
+  // Gather the time each rank has spent waiting in synchronization and print
+  // a per-rank report on rank 0.  This must be called on all ranks.
+  void PrintSynchronizationReport(std::ostream& os);
+
+  // Description:
+  // Get the data array selections used to control which point, cell and
+  // field data arrays are read.  They are populated from the file during
+  // RequestInformation with every array enabled; disabled arrays are
+  // never allocated or scheduled for reading.
+  vtkGetObjectMacro(PointDataArraySelection, vtkDataArraySelection);
+  vtkGetObjectMacro(CellDataArraySelection, vtkDataArraySelection);
+  vtkGetObjectMacro(FieldDataArraySelection, vtkDataArraySelection);
+
+  // Description:
+  // Get the number and names of the point, cell and field data arrays
+  // available in the file.
+  int GetNumberOfPointArrays(void);
+  int GetNumberOfCellArrays(void);
+  int GetNumberOfFieldArrays(void);
+  const char* GetPointArrayName(int index);
+  const char* GetCellArrayName(int index);
+  const char* GetFieldArrayName(int index);
+
+  // Description:
+  // Get/Set whether the point, cell or field data array with the given name
+  // is read.
+  int GetPointArrayStatus(const char* name);
+  int GetCellArrayStatus(const char* name);
+  int GetFieldArrayStatus(const char* name);
+  void SetPointArrayStatus(const char* name, int status);
+  void SetCellArrayStatus(const char* name, int status);
+  void SetFieldArrayStatus(const char* name, int status);
+
+  // Description:
+  // Get the error bound recorded for an array written with a lossy
+  // transform, given its variable path, e.g. "/DataSet/PointData/Pressure".
+  // The mode is an ADIOS::ErrorBound value, or -1 for arrays written without
+  // loss, in which case the tolerance is 0.  Only valid after the
+  // information pass.
+  int GetArrayErrorBoundMode(const char* path);
+  double GetArrayErrorTolerance(const char* path);
+
+  // Description:
+  // Only read blocks where the named point or cell array may have values in
+  // [min, max], e.g. for a threshold or contour downstream.  Blocks are
+  // culled using the per-block min/max ADIOS recorded on write, so blocks
+  // without statistics for the array are always read.  Culled blocks are
+  // left empty in the output.  Extent reads of global images are not
+  // culled.
+  void SetValueRange(const char* arrayName, double min, double max);
+  void RemoveValueRange(void);
+
   // Description:
   // Set the MPI controller.
   void SetController(vtkMPIController*);
@@ -103,18 +210,180 @@ protected:
   // for reading afterwards
   void ReadObject(const ADIOSVarInfo* info, vtkDataArray* data);
   void ReadObject(const vtkADIOSDirTree *dir, vtkCellArray* data);
-  void ReadObject(const vtkADIOSDirTree *dir, vtkFieldData* data);
-  void ReadObject(const vtkADIOSDirTree *dir, vtkDataSetAttributes* data);
+  struct ReadPlanEntry;
+  void ReadObject(const std::vector<ReadPlanEntry>& arrays,
+    vtkFieldData* data);
+  void ReadObject(const std::vector<ReadPlanEntry>& arrays,
+    vtkDataSetAttributes* data);
   void ReadObject(const vtkADIOSDirTree *dir, vtkDataSet* data);
   void ReadObject(const vtkADIOSDirTree *dir, vtkImageData* data);
   void ReadObject(const vtkADIOSDirTree *dir, vtkPolyData* data);
   void ReadObject(const vtkADIOSDirTree *dir, vtkUnstructuredGrid* data);
 
+  // Description:
+  // Create image data covering the given extent from image data written with
+  // global arrays and schedule bounding box reads of only the needed values
+  vtkImageData* ReadGlobalImage(const vtkADIOSDirTree *dir,
+    const int extent[6]);
+  void ReadGlobalArray(const ADIOSVarInfo* info, const int extent[6],
+    bool cellData, vtkDataArray* data);
+
+  // Description:
+  // Read the requested step into the output pieces
+  bool ReadStep(vtkMultiPieceDataSet *outputPieces);
+
+  // Description:
+  // Start reading the step expected to be requested next into staging
+  // pieces without waiting for the data
+  void PrefetchStep(void);
+
+  // Description:
+  // Wait for any prefetched step and return its pieces if it is the step
+  // identified by stepKey, or NULL otherwise
+  vtkSmartPointer<vtkMultiPieceDataSet> CompletePrefetch(
+    const std::string& stepKey);
+
+  // Description:
+  // Wait for the reads of any prefetched step to land and finish them,
+  // dropping the step if they failed.  The file can't be used until then.
+  void WaitForPrefetch(void);
+
+  // Description:
+  // Build the key identifying the requested step, pieces, extent and array
+  // selections in the step cache
+  std::string GetStepCacheKey(void);
+
+  // Description:
+  // Whether a written block of the requested step may hold values of the
+  // value range array within the value range
+  bool BlockIntersectsValueRange(const vtkADIOSDirTree *dir, int block);
+
+  // Description:
+  // Accumulate the size in bytes of each written block of the requested step
+  // over the geometry and selected attribute arrays of the data set in dir
+  void GetBlockSizes(const vtkADIOSDirTree *dir, std::vector<double>& sizes);
+
+  // Description:
+  // Get the step at which the geometry recorded by the named step variable
+  // was last written for the block being read, or the requested step if the
+  // variable is not present.  Like all ADIOS variable steps it only counts
+  // the steps in which the geometry was written.
+  int GetGeometryStep(const vtkADIOSDirTree *dir, const std::string& name);
+
+  // Description:
+  // Get the geometry objects of the named kind read for the block being read
+  // from the current read step.  The list is empty if they have not been
+  // read yet, in which case the caller reads them and adds them to the list
+  // so that later steps sharing the same geometry share the same objects.
+  std::vector<vtkSmartPointer<vtkObject> >& GetGeometry(
+    const std::string& name);
+
+  // Description:
+  // The field, cell and point data arrays of a dataset directory enabled by
+  // the array selections.  A plan is compiled the first time a dataset
+  // directory is read and replayed for every later block and step until the
+  // file is reopened or the selections change.
+  struct ReadPlanEntry
+  {
+    std::string Name;
+    const ADIOSVarInfo *Info;
+  };
+  enum { PLAN_FIELD_DATA = 0, PLAN_CELL_DATA, PLAN_POINT_DATA };
+  struct ReadPlan
+  {
+    std::vector<ReadPlanEntry> Arrays[3];
+  };
+  const ReadPlan& GetReadPlan(const vtkADIOSDirTree *dir);
+
+  // Description:
+  // Convert the arrays read in a stored type other than the one requested,
+  // decode encoded connectivity and rebuild omitted cell locations once
+  // their reads have completed
+  void FinishReads(void);
+
+  // Description:
+  // Drop the post-processing queued for reads that won't complete, along
+  // with any geometry they may have been reading
+  void DiscardReads(void);
+
+  // Description:
+  // Find the attribute with the given name, or NULL if it is not present
+  const ADIOSAttribute* FindAttribute(const std::string& name);
+
+  // Description:
+  // Add the arrays found in the file to the array selections
+  void UpdateArraySelections(void);
+
+  // Description:
+  // Modify the reader when an array selection changes
+  static void SelectionModifiedCallback(vtkObject* caller, unsigned long eid,
+    void* clientdata, void* calldata);
+
   const char *FileName;
   ADIOS_READ_METHOD ReadMethod;
   const char *ReadMethodArguments;
+  ADIOS::SyncPolicy SynchronizationPolicy;
+  bool BroadcastMetadata;
+  bool MetadataIndex;
+
+  // Blocks are only read if the named array may have values in the range
+  bool HasValueRange;
+  std::string ValueRangeArray;
+  double ValueRange[2];
+
   vtkADIOSDirTree Tree;
   ADIOSReader *Reader;
+  vtkDataArraySelection *PointDataArraySelection;
+  vtkDataArraySelection *CellDataArraySelection;
+  vtkDataArraySelection *FieldDataArraySelection;
+  vtkCallbackCommand *SelectionObserver;
+  bool UpdatingArraySelections;
+  unsigned long CacheMemoryLimit;
+  vtkADIOSStepCache StepCache;
+  bool Prefetch;
+  bool Prefetching;
+  int LastStepIndex;
+  std::string PrefetchKey;
+  vtkSmartPointer<vtkMultiPieceDataSet> PrefetchPieces;
+
+  // The geometry last read for each kind and block along with the step it
+  // was read from
+  struct GeometryEntry
+  {
+    GeometryEntry() : Step(-1) { }
+    int Step;
+    std::vector<vtkSmartPointer<vtkObject> > Objects;
+  };
+  std::map<std::pair<std::string, int>, GeometryEntry> Geometry;
+
+  // Compiled read plans by dataset directory
+  std::map<const vtkADIOSDirTree*, ReadPlan> ReadPlans;
+
+  // Arrays being read in their stored type and the arrays they will be
+  // converted into
+  std::vector<std::pair<vtkSmartPointer<vtkDataArray>,
+    vtkSmartPointer<vtkDataArray> > > Conversions;
+
+  // Encoded connectivity being read and the cells it will be decoded into
+  struct CellDecoding
+  {
+    vtkSmartPointer<vtkDataArray> Stored;
+    vtkSmartPointer<vtkCellArray> Cells;
+    int Encoding;
+    vtkIdType NumberOfCells;
+    int CellSize;
+  };
+  std::vector<CellDecoding> Decodings;
+
+  // Cell locations to rebuild from the connectivity of the cells read.  A
+  // non-zero CellSize means every cell has that many points.
+  struct CellLocations
+  {
+    vtkSmartPointer<vtkCellArray> Cells;
+    vtkSmartPointer<vtkIdTypeArray> Locations;
+    int CellSize;
+  };
+  std::vector<CellLocations> Locations;
   vtkSmartPointer<vtkMPIController> Controller;
 
   vtkADIOSReader();
@@ -140,6 +409,18 @@ protected:
   int RequestStepIndex;
   int RequestNumberOfPieces;
   int RequestPiece;
+
+  // The written block currently being read and the step it is read from.
+  // Geometry left unchanged by the writer is read from the step at which
+  // it was last written rather than the requested step.
+  int ReadBlock;
+  int ReadStepIndex;
+
+  // Image data written with global arrays can be read by extent
+  bool GlobalImage;
+  int WholeExtent[6];
+  bool HasRequestExtent;
+  int RequestExtent[6];
   vtkSmartPointer<vtkDataObject> Output;
 
 private:
@@ -0,0 +1,102 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkADIOSStepCache.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#include "vtkADIOSStepCache.h"
+
+//----------------------------------------------------------------------------
+vtkADIOSStepCache::vtkADIOSStepCache(void)
+: MemoryLimit(0), MemorySize(0)
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSStepCache::SetMemoryLimit(unsigned long limit)
+{
+  this->MemoryLimit = limit;
+  this->Evict(limit);
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkADIOSStepCache::GetMemoryLimit(void) const
+{
+  return this->MemoryLimit;
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkADIOSStepCache::GetMemorySize(void) const
+{
+  return this->MemorySize;
+}
+
+//----------------------------------------------------------------------------
+vtkDataObject* vtkADIOSStepCache::Find(const std::string& key)
+{
+  IndexMap::iterator i = this->Index.find(key);
+  if(i == this->Index.end())
+    {
+    return NULL;
+    }
+
+  // Move to the front of the list, which doesn't invalidate any iterators
+  this->Entries.splice(this->Entries.begin(), this->Entries, i->second);
+  return i->second->Data;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSStepCache::Insert(const std::string& key, vtkDataObject* data,
+  unsigned long size)
+{
+  IndexMap::iterator i = this->Index.find(key);
+  if(i != this->Index.end())
+    {
+    this->MemorySize -= i->second->Size;
+    this->Entries.erase(i->second);
+    this->Index.erase(i);
+    }
+
+  if(size > this->MemoryLimit)
+    {
+    return;
+    }
+
+  this->Evict(this->MemoryLimit - size);
+
+  Entry e;
+  e.Key = key;
+  e.Data = data;
+  e.Size = size;
+  this->Entries.push_front(e);
+  this->Index[key] = this->Entries.begin();
+  this->MemorySize += size;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSStepCache::Clear(void)
+{
+  this->Entries.clear();
+  this->Index.clear();
+  this->MemorySize = 0;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSStepCache::Evict(unsigned long limit)
+{
+  while(this->MemorySize > limit && !this->Entries.empty())
+    {
+    const Entry &e = this->Entries.back();
+    this->MemorySize -= e.Size;
+    this->Index.erase(e.Key);
+    this->Entries.pop_back();
+    }
+}
@@ -0,0 +1,77 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkADIOSStepCache.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkADIOSStepCache - A memory bounded LRU cache of read data objects
+
+#ifndef __vtkADIOSStepCache_h
+#define __vtkADIOSStepCache_h
+
+#include <string>
+#include <list>
+#include <map>
+
+#include <vtkSmartPointer.h>
+#include <vtkDataObject.h>
+
+class vtkADIOSStepCache
+{
+public:
+  vtkADIOSStepCache(void);
+
+  // Description:
+  // Get/Set the memory budget in kibibytes.  Least recently used entries
+  // are evicted to stay within it, and a budget of 0 disables caching.
+  void SetMemoryLimit(unsigned long limit);
+  unsigned long GetMemoryLimit(void) const;
+
+  // Description:
+  // Retrieve the total size in kibibytes of all cached objects
+  unsigned long GetMemorySize(void) const;
+
+  // Description:
+  // Retrieve a cached object and mark it most recently used.  Returns NULL
+  // if the key is not cached.
+  vtkDataObject* Find(const std::string& key);
+
+  // Description:
+  // Cache an object of the given size in kibibytes, replacing any previous
+  // entry with the same key.  Objects larger than the budget are not cached.
+  void Insert(const std::string& key, vtkDataObject* data,
+    unsigned long size);
+
+  // Description:
+  // Remove all cached objects
+  void Clear(void);
+
+private:
+  struct Entry
+  {
+    std::string Key;
+    vtkSmartPointer<vtkDataObject> Data;
+    unsigned long Size;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::map<std::string, EntryList::iterator> IndexMap;
+
+  void Evict(unsigned long limit);
+
+  unsigned long MemoryLimit;
+  unsigned long MemorySize;
+
+  // Ordered from most to least recently used
+  EntryList Entries;
+  IndexMap Index;
+};
+
+#endif
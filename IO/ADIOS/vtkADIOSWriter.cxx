@@ -12,11 +12,14 @@
      PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
+#include <algorithm>
 #include <cstring>
 #include <limits>
+#include <sstream>
 #include <stdexcept>
 #include <iostream>
 
+#include "ADIOSUtilities.h"
 #include "ADIOSWriter.h"
 
 #include "vtkADIOSWriter.h"
@@ -26,6 +29,7 @@
 #include <vtkDemandDrivenPipeline.h>
 #include <vtkStreamingDemandDrivenPipeline.h>
 #include <vtkMPIController.h>
+#include <vtkCommunicator.h>
 #include <vtkMPI.h>
 
 #include <vtkDataObject.h>
@@ -53,12 +57,26 @@ vtkStandardNewMacro(vtkADIOSWriter);
 vtkADIOSWriter::vtkADIOSWriter()
 : FileName(""), TransportMethod(ADIOS::TransportMethod_POSIX),
   TransportMethodArguments(""), Transform(ADIOS::Transform_NONE),
+  ErrorBoundMode(ADIOS::ErrorBound_Absolute), ErrorTolerance(1e-4),
+  CellEncoding(ADIOS::CellEncoding_Legacy), WriteCellLocations(true),
+  HomogeneousCells(false),
+  ReduceDoublePrecision(false), NarrowIntegerArrays(false),
+  GlobalImageArrays(false), SkipUnchangedGeometry(false),
+  HashGeometry(false), BufferHeadroom(1.25),
+  SynchronizationPolicy(ADIOS::SyncPolicy_Barrier),
+  AsynchronousWrites(false), WriteQueueDepth(2),
   Writer(NULL), Controller(NULL),
   NumberOfPieces(-1), RequestPiece(-1), NumberOfGhostLevels(-1),
   WriteAllTimeSteps(true), TimeSteps(), CurrentTimeStep(TimeSteps.begin())
 {
   std::memset(this->RequestExtent, 0, 6*sizeof(int));
-  std::memset(this->WholeExtent, 0, 6*sizeof(int));
+
+  // Start with an empty whole extent until one is provided by the pipeline
+  for(int i = 0; i < 6; i += 2)
+    {
+    this->WholeExtent[i] = 0;
+    this->WholeExtent[i+1] = -1;
+    }
   this->SetNumberOfInputPorts(1);
   this->SetNumberOfOutputPorts(0);
 }
@@ -66,7 +84,11 @@ vtkADIOSWriter::vtkADIOSWriter()
 //----------------------------------------------------------------------------
 vtkADIOSWriter::~vtkADIOSWriter()
 {
-  delete this->Writer;
+  if(this->Writer)
+    {
+    this->Writer->SetSyncPolicy(this->SynchronizationPolicy);
+    delete this->Writer;
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -74,6 +96,497 @@ void vtkADIOSWriter::PrintSelf(std::ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
   os << indent << "FileName: " << this->FileName << std::endl;
+  os << indent << "AsynchronousWrites: " << this->AsynchronousWrites
+     << std::endl;
+  os << indent << "WriteQueueDepth: " << this->WriteQueueDepth << std::endl;
+  os << indent << "Transform: " << ADIOS::ToString(this->Transform)
+     << std::endl;
+  os << indent << "ErrorBoundMode: " << ADIOS::ToString(this->ErrorBoundMode)
+     << std::endl;
+  os << indent << "ErrorTolerance: " << this->ErrorTolerance << std::endl;
+  for(size_t i = 0; i < this->TransformRules.size(); ++i)
+    {
+    const TransformRule &r = this->TransformRules[i];
+    os << indent << "TransformRule " << i << ": " << r.Pattern << ' '
+       << r.DataType << ' ' << r.MinSize << ' '
+       << ADIOS::ToString(r.Transform) << ' ' << r.Parameters << std::endl;
+    }
+  os << indent << "CellEncoding: " << ADIOS::ToString(this->CellEncoding)
+     << std::endl;
+  os << indent << "WriteCellLocations: " << this->WriteCellLocations
+     << std::endl;
+  os << indent << "HomogeneousCells: " << this->HomogeneousCells
+     << std::endl;
+  os << indent << "ReduceDoublePrecision: " << this->ReduceDoublePrecision
+     << std::endl;
+  os << indent << "NarrowIntegerArrays: " << this->NarrowIntegerArrays
+     << std::endl;
+  os << indent << "GlobalImageArrays: " << this->GlobalImageArrays
+     << std::endl;
+  os << indent << "SkipUnchangedGeometry: " << this->SkipUnchangedGeometry
+     << std::endl;
+  os << indent << "HashGeometry: " << this->HashGeometry << std::endl;
+  os << indent << "SynchronizationPolicy: "
+     << ADIOS::ToString(this->SynchronizationPolicy) << std::endl;
+  os << indent << "BufferHeadroom: " << this->BufferHeadroom << std::endl;
+  os << indent << "BufferSize: " << this->GetBufferSize() << std::endl;
+  os << indent << "NumberOfBufferOverflows: "
+     << this->GetNumberOfBufferOverflows() << std::endl;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::PrintSynchronizationReport(std::ostream& os)
+{
+  if(!this->Controller)
+    {
+    return;
+    }
+
+  ADIOSUtilities::PrintSyncReport(this->Controller,
+    ADIOSWriter::GetSyncWaitTime(), "writer synchronization (" +
+    ADIOS::ToString(this->SynchronizationPolicy) + ")", os);
+}
+
+//----------------------------------------------------------------------------
+bool vtkADIOSWriter::Flush(void)
+{
+  if(!this->Writer)
+    {
+    return true;
+    }
+
+  try
+    {
+    this->Writer->Flush();
+    }
+  catch(const std::runtime_error &err)
+    {
+    vtkErrorMacro(<< err.what());
+    return false;
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkADIOSWriter::GetBufferSize(void) const
+{
+  return this->Writer ? this->Writer->GetBufferSize() : 0;
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkADIOSWriter::GetNumberOfBufferOverflows(void) const
+{
+  return this->Writer ? this->Writer->GetNumberOfBufferOverflows() : 0;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::AddTransformRule(const char *pattern, int dataType,
+  vtkIdType minSize, ADIOS::Transform xfm, const char *parameters)
+{
+  TransformRule rule;
+  rule.Pattern = pattern ? pattern : "*";
+  rule.DataType = dataType;
+  rule.MinSize = minSize;
+  rule.Transform = xfm;
+  rule.Parameters = parameters ? parameters : "";
+  rule.ErrorBoundMode = this->ErrorBoundMode;
+  rule.ErrorTolerance = this->ErrorTolerance;
+  this->TransformRules.push_back(rule);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::AddLossyTransformRule(const char *pattern,
+  vtkIdType minSize, ADIOS::Transform xfm, ADIOS::ErrorBound mode,
+  double tolerance)
+{
+  TransformRule rule;
+  rule.Pattern = pattern ? pattern : "*";
+  rule.DataType = -1;
+  rule.MinSize = minSize;
+  rule.Transform = xfm;
+  rule.ErrorBoundMode = mode;
+  rule.ErrorTolerance = tolerance;
+  this->TransformRules.push_back(rule);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::ClearTransformRules(void)
+{
+  if(!this->TransformRules.empty())
+    {
+    this->TransformRules.clear();
+    this->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+// Match a string against a pattern with '*' and '?' wildcards
+static bool MatchPattern(const char *str, const char *pattern)
+{
+  const char *star = NULL, *starStr = NULL;
+  while(*str)
+    {
+    if(*pattern == '?' || *pattern == *str)
+      {
+      ++str;
+      ++pattern;
+      }
+    else if(*pattern == '*')
+      {
+      star = pattern++;
+      starStr = str;
+      }
+    else if(star)
+      {
+      // Let the last '*' absorb one more character and try again
+      pattern = star + 1;
+      str = ++starStr;
+      }
+    else
+      {
+      return false;
+      }
+    }
+  while(*pattern == '*')
+    {
+    ++pattern;
+    }
+  return *pattern == '\0';
+}
+
+//----------------------------------------------------------------------------
+ADIOS::Transform vtkADIOSWriter::DefineTransform(const std::string& path,
+  vtkAbstractArray *value, std::string& parameters)
+{
+  int type = value->GetDataType();
+  bool floating = type == VTK_FLOAT || type == VTK_DOUBLE;
+  vtkIdType size = value->GetNumberOfTuples() *
+    value->GetNumberOfComponents() * value->GetDataTypeSize();
+
+  // Sizes are compared by the largest piece so that every process picks the
+  // same rule, and with it the same collective error bound below
+  bool sizedRules = false;
+  for(std::vector<TransformRule>::const_iterator r =
+    this->TransformRules.begin(); r != this->TransformRules.end(); ++r)
+    {
+    sizedRules = sizedRules || r->MinSize > 0;
+    }
+  if(sizedRules)
+    {
+    vtkIdType localSize = size;
+    this->Controller->AllReduce(&localSize, &size, 1,
+      vtkCommunicator::MAX_OP);
+    }
+
+  // Lossy transforms only ever apply to floating point data
+  TransformRule rule;
+  rule.Transform = this->Transform;
+  rule.ErrorBoundMode = this->ErrorBoundMode;
+  rule.ErrorTolerance = this->ErrorTolerance;
+  for(std::vector<TransformRule>::const_iterator r =
+    this->TransformRules.begin(); r != this->TransformRules.end(); ++r)
+    {
+    if((r->DataType == -1 || r->DataType == type) &&
+      (floating || !ADIOS::IsLossy(r->Transform)) &&
+      size >= r->MinSize && MatchPattern(path.c_str(), r->Pattern.c_str()))
+      {
+      rule = *r;
+      break;
+      }
+    }
+
+  parameters = rule.Parameters;
+  if(!ADIOS::IsLossy(rule.Transform))
+    {
+    return rule.Transform;
+    }
+  if(!floating)
+    {
+    parameters.clear();
+    return ADIOS::Transform_NONE;
+    }
+
+  // The error bound is passed to the transform as its parameters, and the
+  // bound actually applied is recorded for readers
+  bool zfp = rule.Transform == ADIOS::Transform_ZFP;
+  ADIOS::ErrorBound appliedMode = rule.ErrorBoundMode;
+  double appliedTolerance = rule.ErrorTolerance;
+  std::ostringstream params;
+  params.precision(10);
+  switch(rule.ErrorBoundMode)
+    {
+    case ADIOS::ErrorBound_Absolute:
+      params << (zfp ? "accuracy=" : "abs=") << rule.ErrorTolerance;
+      break;
+    case ADIOS::ErrorBound_Relative:
+      if(zfp)
+        {
+        // ZFP only bounds the absolute error so scale by the value range
+        // of the first step over all processes.  Later steps may have a
+        // wider range so the absolute bound is what's recorded.
+        vtkDataArray *da = vtkDataArray::SafeDownCast(value);
+        int nc = value->GetNumberOfComponents();
+        std::vector<double> localRanges(2*nc, -VTK_DOUBLE_MAX);
+        for(int c = 0; da && da->GetNumberOfTuples() > 0 && c < nc; ++c)
+          {
+          double r[2];
+          da->GetRange(r, c);
+          localRanges[2*c] = -r[0];
+          localRanges[2*c+1] = r[1];
+          }
+        std::vector<double> ranges(2*nc, 0.0);
+        if(nc > 0)
+          {
+          this->Controller->AllReduce(&localRanges[0], &ranges[0], 2*nc,
+            vtkCommunicator::MAX_OP);
+          }
+        double range = 0.0;
+        for(int c = 0; c < nc; ++c)
+          {
+          range = std::max(range, ranges[2*c+1] + ranges[2*c]);
+          }
+        appliedMode = ADIOS::ErrorBound_Absolute;
+        appliedTolerance = rule.ErrorTolerance * (range > 0.0 ? range : 1.0);
+        params << "accuracy=" << appliedTolerance;
+        }
+      else
+        {
+        params << "rel=" << rule.ErrorTolerance;
+        }
+      break;
+    case ADIOS::ErrorBound_Rate:
+      if(!zfp)
+        {
+        vtkWarningMacro(<< "SZ does not support a fixed rate, writing "
+          << path << " without a transform");
+        parameters.clear();
+        return ADIOS::Transform_NONE;
+        }
+      // A tolerance meant for another mode, e.g. the default, makes no
+      // sense as a number of bits per value
+      if(rule.ErrorTolerance < 1.0 ||
+        rule.ErrorTolerance > 8*value->GetDataTypeSize())
+        {
+        vtkWarningMacro(<< "ZFP rate " << rule.ErrorTolerance
+          << " is not between 1 and the " << 8*value->GetDataTypeSize()
+          << " bits per value, writing " << path << " without a transform");
+        parameters.clear();
+        return ADIOS::Transform_NONE;
+        }
+      params << "rate=" << rule.ErrorTolerance;
+      break;
+    }
+  parameters = params.str();
+
+  // Record the error bound so that readers can report it
+  if(this->RequestPiece == 0)
+    {
+    this->Writer->DefineAttribute<int>(path+"/ErrorBoundMode", appliedMode);
+    this->Writer->DefineAttribute<double>(path+"/ErrorTolerance",
+      appliedTolerance);
+    }
+  return rule.Transform;
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::AddStorageTypeRule(const char *pattern, int storedType)
+{
+  this->StorageTypeRules.push_back(
+    std::make_pair(std::string(pattern ? pattern : "*"), storedType));
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::ClearStorageTypeRules(void)
+{
+  if(!this->StorageTypeRules.empty())
+    {
+    this->StorageTypeRules.clear();
+    this->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+// Find the smallest integer type narrower than the array's own type that
+// holds all of its values on every process.  Every process writes blocks of
+// the same variable, so they must agree on its type.
+static int NarrowestIntegerType(vtkDataArray *da,
+  vtkMultiProcessController *controller)
+{
+  // Reduced as (-min, max) so that a single max reduction does
+  double localRange[2] = { -VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+  for(int c = 0; c < da->GetNumberOfComponents() &&
+    da->GetNumberOfTuples() > 0; ++c)
+    {
+    double r[2];
+    da->GetRange(r, c);
+    localRange[0] = std::max(localRange[0], -r[0]);
+    localRange[1] = std::max(localRange[1], r[1]);
+    }
+
+  double range[2];
+  controller->AllReduce(localRange, range, 2, vtkCommunicator::MAX_OP);
+  range[0] = -range[0];
+  if(range[0] > range[1])
+    {
+    return VTK_VOID;
+    }
+
+  static const int types[] = { VTK_TYPE_UINT8, VTK_TYPE_INT8,
+    VTK_TYPE_UINT16, VTK_TYPE_INT16, VTK_TYPE_UINT32, VTK_TYPE_INT32 };
+  static const double mins[] = { 0.0, -128.0, 0.0, -32768.0, 0.0,
+    -2147483648.0 };
+  static const double maxs[] = { 255.0, 127.0, 65535.0, 32767.0,
+    4294967295.0, 2147483647.0 };
+  static const int sizes[] = { 1, 1, 2, 2, 4, 4 };
+  for(int i = 0; i < 6 && sizes[i] < da->GetDataTypeSize(); ++i)
+    {
+    if(mins[i] <= range[0] && range[1] <= maxs[i])
+      {
+      return types[i];
+      }
+    }
+  return VTK_VOID;
+}
+
+//----------------------------------------------------------------------------
+int vtkADIOSWriter::DefineStorageType(const std::string& path,
+  vtkAbstractArray *value)
+{
+  int type = value->GetDataType();
+  vtkDataArray *da = vtkDataArray::SafeDownCast(value);
+  bool integer = da && type != VTK_FLOAT && type != VTK_DOUBLE;
+
+  int stored = VTK_VOID;
+  if(type == VTK_DOUBLE && this->ReduceDoublePrecision)
+    {
+    stored = VTK_FLOAT;
+    }
+  else if(integer && this->NarrowIntegerArrays)
+    {
+    stored = NARROWEST_INTEGER_TYPE;
+    }
+  for(std::vector<std::pair<std::string, int> >::const_iterator r =
+    this->StorageTypeRules.begin(); r != this->StorageTypeRules.end(); ++r)
+    {
+    if(MatchPattern(path.c_str(), r->first.c_str()))
+      {
+      stored = r->second;
+      break;
+      }
+    }
+
+  if(stored == NARROWEST_INTEGER_TYPE)
+    {
+    stored = integer ? NarrowestIntegerType(da, this->Controller) :
+      VTK_VOID;
+    }
+  if(!da || stored == VTK_VOID || stored == type)
+    {
+    this->StorageTypes.erase(path);
+    return type;
+    }
+  this->StorageTypes[path] = stored;
+  return stored;
+}
+
+//----------------------------------------------------------------------------
+// Convert an array into its stored type in a staging buffer
+static const void* ConvertToStored(const std::string& path,
+  vtkAbstractArray *value, int storedType, std::vector<char>& buf)
+{
+  // The staging buffer must outlive the step so it is reused across steps
+  size_t n = static_cast<size_t>(value->GetNumberOfTuples()) *
+    value->GetNumberOfComponents();
+  buf.resize(std::max<size_t>(n * vtkAbstractArray::GetDataTypeSize(storedType),
+    1));
+  if(!ADIOSUtilities::ConvertValues(value->GetVoidPointer(0),
+    value->GetDataType(), &buf[0], storedType, n))
+    {
+    throw std::runtime_error("Values of " + path +
+      " are out of range of the type it is stored as");
+    }
+  return &buf[0];
+}
+
+//----------------------------------------------------------------------------
+const void* vtkADIOSWriter::GetStoredData(const std::string& path,
+  vtkAbstractArray *value)
+{
+  std::map<std::string, int>::const_iterator t =
+    this->StorageTypes.find(path);
+  if(t == this->StorageTypes.end())
+    {
+    return value->GetVoidPointer(0);
+    }
+  return ConvertToStored(path, value, t->second, this->StagingBuffers[path]);
+}
+
+//----------------------------------------------------------------------------
+const void* vtkADIOSWriter::GetStoredData(const WritePlanEntry& entry,
+  vtkAbstractArray *value)
+{
+  if(!entry.Staging)
+    {
+    return value->GetVoidPointer(0);
+    }
+  return ConvertToStored(entry.Path, value, entry.StoredType,
+    *entry.Staging);
+}
+
+//----------------------------------------------------------------------------
+const std::vector<vtkADIOSWriter::WritePlanEntry>&
+vtkADIOSWriter::GetWritePlan(const std::string& path, vtkFieldData *value)
+{
+  std::vector<WritePlanEntry> &plan = this->WritePlans[path];
+
+  // The plan stays valid as long as the arrays keep their order, names,
+  // types and number of components
+  int numArrays = value->GetNumberOfArrays();
+  bool valid = static_cast<int>(plan.size()) == numArrays;
+  for(int i = 0; valid && i < numArrays; ++i)
+    {
+    const WritePlanEntry &e = plan[i];
+    vtkDataArray *da = value->GetArray(i);
+    vtkAbstractArray *aa = da ? da : value->GetAbstractArray(i);
+    const char *name = aa->GetName();
+    valid = e.Name == (name ? name : "") &&
+      e.DataType == aa->GetDataType() &&
+      e.NumberOfComponents == aa->GetNumberOfComponents() &&
+      e.IsDataArray == (da != NULL) &&
+      e.HasLookupTable == (da && da->GetLookupTable());
+    }
+  if(valid)
+    {
+    return plan;
+    }
+
+  plan.resize(numArrays);
+  for(int i = 0; i < numArrays; ++i)
+    {
+    WritePlanEntry &e = plan[i];
+    vtkDataArray *da = value->GetArray(i);
+    vtkAbstractArray *aa = da ? da : value->GetAbstractArray(i);
+    const char *name = aa->GetName();
+    e.Index = i;
+    e.Name = name ? name : "";
+    e.DataType = aa->GetDataType();
+    e.NumberOfComponents = aa->GetNumberOfComponents();
+    e.IsDataArray = da != NULL;
+    e.HasLookupTable = da && da->GetLookupTable();
+    e.Skip = e.Name.empty();
+    e.Path = path + "/" + e.Name;
+    e.Handle = e.Skip || e.DataType == VTK_STRING ? -1 :
+      this->Writer->GetArrayHandle(e.Path);
+    std::map<std::string, int>::const_iterator t =
+      this->StorageTypes.find(e.Path);
+    e.StoredType = t != this->StorageTypes.end() ? t->second : VTK_VOID;
+    e.Staging = t != this->StorageTypes.end() ?
+      &this->StagingBuffers[e.Path] : NULL;
+    }
+  return plan;
 }
 
 //----------------------------------------------------------------------------
@@ -98,11 +611,19 @@ void vtkADIOSWriter::SetController(vtkMPIController *controller)
   this->NumberOfPieces = this->Controller->GetNumberOfProcesses();
   this->RequestPiece = this->Controller->GetLocalProcessId();
   this->FirstStep = true;
+  this->Geometry.clear();
+  this->StorageTypes.clear();
+  this->StagingBuffers.clear();
+  this->WritePlans.clear();
 }
 
 //----------------------------------------------------------------------------
 void vtkADIOSWriter::OpenFile(void)
 {
+  this->Writer->SetBufferHeadroom(this->BufferHeadroom);
+  this->Writer->SetSyncPolicy(this->SynchronizationPolicy);
+  this->Writer->SetAsynchronous(this->AsynchronousWrites ?
+    std::max(this->WriteQueueDepth, 1) : 0);
   this->Writer->Open(this->FileName, !this->FirstStep);
   this->FirstStep = false;
 }
@@ -110,7 +631,14 @@ void vtkADIOSWriter::OpenFile(void)
 //----------------------------------------------------------------------------
 void vtkADIOSWriter::CloseFile(void)
 {
+  size_t numOverflows = this->Writer->GetNumberOfBufferOverflows();
   this->Writer->Close();
+  if(this->Writer->GetNumberOfBufferOverflows() != numOverflows)
+    {
+    vtkWarningMacro(<< "Step of " << this->Writer->GetStepSize()
+      << " bytes overflowed the " << this->Writer->GetBufferSize()
+      << " byte ADIOS buffer");
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -164,6 +692,103 @@ bool vtkADIOSWriter::DefineAndWrite(void)
   return true;
 }
 
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::GetWholeExtent(const vtkImageData* v, int whole[6])
+{
+  if(this->WholeExtent[0] <= this->WholeExtent[1] &&
+     this->WholeExtent[2] <= this->WholeExtent[3] &&
+     this->WholeExtent[4] <= this->WholeExtent[5])
+    {
+    std::copy(this->WholeExtent, this->WholeExtent+6, whole);
+    return;
+    }
+
+  // Without pipeline information the whole extent is the union of all pieces
+  int *extent = const_cast<vtkImageData*>(v)->GetExtent();
+  int extMin[3] = { extent[0], extent[2], extent[4] };
+  int extMax[3] = { extent[1], extent[3], extent[5] };
+  int wholeMin[3], wholeMax[3];
+  this->Controller->AllReduce(extMin, wholeMin, 3,
+    vtkCommunicator::MIN_OP);
+  this->Controller->AllReduce(extMax, wholeMax, 3,
+    vtkCommunicator::MAX_OP);
+  for(int i = 0; i < 3; ++i)
+    {
+    whole[2*i] = wholeMin[i];
+    whole[2*i+1] = wholeMax[i];
+    }
+}
+
+//----------------------------------------------------------------------------
+// FNV-1a hash of the raw contents of an array
+static vtkTypeUInt64 HashArray(vtkAbstractArray *a, vtkTypeUInt64 h)
+{
+  const unsigned char *data =
+    reinterpret_cast<const unsigned char*>(a->GetVoidPointer(0));
+  size_t n = static_cast<size_t>(a->GetNumberOfTuples()) *
+    a->GetNumberOfComponents() * a->GetDataTypeSize();
+  h = (h ^ static_cast<vtkTypeUInt64>(a->GetDataType())) * 1099511628211ULL;
+  h = (h ^ static_cast<vtkTypeUInt64>(n)) * 1099511628211ULL;
+  for(size_t i = 0; i < n; ++i)
+    {
+    h = (h ^ data[i]) * 1099511628211ULL;
+    }
+  return h;
+}
+
+//----------------------------------------------------------------------------
+bool vtkADIOSWriter::UpdateGeometry(const std::string& path,
+  const std::vector<vtkObject*>& objects, int& lastStep)
+{
+  GeometryState &state = this->Geometry[path];
+
+  unsigned long mtime = 0;
+  for(size_t i = 0; i < objects.size(); ++i)
+    {
+    mtime = std::max(mtime, objects[i]->GetMTime());
+    }
+
+  // Identical objects that haven't been modified since the last step can't
+  // have changed, otherwise fall back to comparing the contents if requested
+  bool always = state.Step < 0 || !this->SkipUnchangedGeometry;
+  int changed = always || objects != state.Objects || mtime != state.MTime;
+  if(changed && this->HashGeometry)
+    {
+    vtkTypeUInt64 hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < objects.size(); ++i)
+      {
+      vtkAbstractArray *a = vtkAbstractArray::SafeDownCast(objects[i]);
+      if(a && a->GetDataType() != VTK_STRING)
+        {
+        hash = HashArray(a, hash);
+        }
+      }
+    changed = always || hash != state.Hash;
+    state.Hash = hash;
+    }
+  state.Objects = objects;
+  state.MTime = mtime;
+
+  // Either every rank writes the geometry or none do so that the blocks of
+  // each step stay in rank order
+  if(this->SkipUnchangedGeometry)
+    {
+    int anyChanged;
+    this->Controller->AllReduce(&changed, &anyChanged, 1,
+      vtkCommunicator::MAX_OP);
+    changed = anyChanged;
+    }
+
+  // ADIOS counts the steps of each variable separately so the step recorded
+  // is the number of times the geometry has been written before
+  if(changed)
+    {
+    ++state.Step;
+    }
+  lastStep = state.Step;
+  return changed != 0;
+}
+
 //----------------------------------------------------------------------------
 bool vtkADIOSWriter::WriteInternal(void)
 {
@@ -249,6 +874,12 @@ bool vtkADIOSWriter::RequestInformation(vtkInformation *req,
     this->CurrentTimeStep = this->TimeSteps.begin();
     }
 
+  if(inInfo->Has(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT()))
+    {
+    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(),
+      this->WholeExtent);
+    }
+
   return true;
 }
 
@@ -287,10 +918,15 @@ bool vtkADIOSWriter::RequestData(vtkInformation *req,
     }
 
   // End looping if we're at the end
-  if(++this->CurrentTimeStep == this->TimeSteps.end() &&
-     this->WriteAllTimeSteps)
+  if(++this->CurrentTimeStep == this->TimeSteps.end())
     {
-    req->Set(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING(), 0);
+    if(this->WriteAllTimeSteps)
+      {
+      req->Set(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING(), 0);
+      }
+
+    // Make sure any asynchronous writes have landed before reporting success
+    return this->Flush();
     }
 
   return true;
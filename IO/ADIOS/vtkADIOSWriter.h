@@ -19,6 +19,7 @@
 #ifndef __vtkADIOSWriter_h
 #define __vtkADIOSWriter_h
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -33,6 +34,7 @@
 
 class ADIOSWriter;
 
+class vtkObject;
 class vtkAbstractArray;
 class vtkDataArray;
 class vtkCellArray;
@@ -71,13 +73,184 @@ public:
 
   // Description:
   // Get/Set the data transformation.  Currently valid values are:
-  // NONE (default), ZLIB, BZLIB2, and SZIP.  Check the configuration of your
-  // ADIOS library to determine the supported transform.  If called, it
-  // must be called BEFORE the first step. The transform will be applied to
-  // all arrays
+  // NONE (default), ZLIB, BZLIB2, SZIP, and the lossy ZFP and SZ.  Check the
+  // configuration of your ADIOS library to determine the supported
+  // transform.  If called, it must be called BEFORE the first step. The
+  // transform will be applied to all arrays not matched by a transform rule.
+  // Lossy transforms only apply to floating point arrays and use the error
+  // bound below.
   vtkSetMacro(Transform, ADIOS::Transform)
   vtkGetMacro(Transform, ADIOS::Transform)
 
+  // Description:
+  // Get/Set the error bound of a lossy Transform: the maximum absolute error
+  // (Absolute, default), the maximum error relative to the value range of
+  // each array over all pieces in the first step (Relative) or a fixed
+  // number of bits per value (Rate, ZFP only, from 1 up to the bits of the
+  // type) given by the tolerance (default 1e-4, so Rate needs a tolerance
+  // of its own).  ZFP only bounds absolute errors, so with ZFP a Relative
+  // bound is applied, and recorded for readers, as the absolute bound it
+  // gives on the first step.
+  vtkSetMacro(ErrorBoundMode, ADIOS::ErrorBound)
+  vtkGetMacro(ErrorBoundMode, ADIOS::ErrorBound)
+  vtkSetMacro(ErrorTolerance, double)
+  vtkGetMacro(ErrorTolerance, double)
+
+  // Description:
+  // Add a rule choosing the transform for individual arrays.  A rule matches
+  // arrays whose variable path, e.g. "/DataSet/PointData/Temperature" or
+  // "/Cells/IndexArray", matches pattern ('*' and '?' wildcards), whose VTK
+  // data type is dataType (-1 for any) and whose size in bytes on the first
+  // step is at least minSize.  The first matching rule in the order added
+  // applies, with parameters passed on to the transform as is (e.g. "9" for
+  // the ZLIB compression level).  If called, it must be called BEFORE the
+  // first step.
+  void AddTransformRule(const char *pattern, int dataType,
+    vtkIdType minSize, ADIOS::Transform xfm, const char *parameters = "");
+
+  // Description:
+  // Add a rule applying a lossy transform with the given error bound to the
+  // floating point arrays whose path matches pattern and whose size in bytes
+  // on the first step is at least minSize
+  void AddLossyTransformRule(const char *pattern, vtkIdType minSize,
+    ADIOS::Transform xfm, ADIOS::ErrorBound mode, double tolerance);
+
+  // Description:
+  // Remove all transform rules
+  void ClearTransformRules(void);
+
+  // Description:
+  // Get/Set how the connectivity of cell arrays is stored: as the legacy
+  // vtkIdType (npts, id, id, ...) stream (Legacy, default), as 32-bit ids
+  // without per-cell counts when all cells are the same size (Compact) or
+  // as variable length, zigzag encoded differences between successive ids
+  // (Delta).  If called, it must be called BEFORE the first step.
+  vtkSetMacro(CellEncoding, ADIOS::CellEncoding)
+  vtkGetMacro(CellEncoding, ADIOS::CellEncoding)
+
+  // Description:
+  // Get/Set whether the cell locations of unstructured grids are written
+  // (default on).  They are fully determined by the connectivity so readers
+  // rebuild them when they are omitted.  If called, it must be called
+  // BEFORE the first step.
+  vtkSetMacro(WriteCellLocations, bool)
+  vtkGetMacro(WriteCellLocations, bool)
+  vtkBooleanMacro(WriteCellLocations, bool)
+
+  // Description:
+  // Get/Set whether unstructured grids whose cells are all of one type store
+  // just that type rather than the type of every cell (default off).
+  // Combined with a Compact or Delta CellEncoding the connectivity of such
+  // grids is also written without per-cell counts.  Readers predating this
+  // option can't read such grids.  If called, it must be called BEFORE the
+  // first step.
+  vtkSetMacro(HomogeneousCells, bool)
+  vtkGetMacro(HomogeneousCells, bool)
+  vtkBooleanMacro(HomogeneousCells, bool)
+
+  // Description:
+  // Get/Set whether double arrays are stored as float (default off)
+  vtkSetMacro(ReduceDoublePrecision, bool)
+  vtkGetMacro(ReduceDoublePrecision, bool)
+  vtkBooleanMacro(ReduceDoublePrecision, bool)
+
+  // Description:
+  // Get/Set whether integer arrays are stored in the narrowest integer type
+  // holding their range over all processes on the first step (default off).
+  // Writing a later step with values outside of that type fails.
+  vtkSetMacro(NarrowIntegerArrays, bool)
+  vtkGetMacro(NarrowIntegerArrays, bool)
+  vtkBooleanMacro(NarrowIntegerArrays, bool)
+
+  // Description:
+  // Add a rule choosing the type arrays whose path matches pattern are
+  // stored as, overriding the options above: a VTK datatype to convert to,
+  // NATIVE_TYPE to keep the array's own type or NARROWEST_INTEGER_TYPE.
+  // The first matching rule in the order added applies.  Arrays are
+  // converted into staging buffers as they are written and read back in
+  // the stored type.  If called, it must be called BEFORE the first step.
+  enum { NATIVE_TYPE = VTK_VOID, NARROWEST_INTEGER_TYPE = -1 };
+  void AddStorageTypeRule(const char *pattern, int storedType);
+  void ClearStorageTypeRules(void);
+
+  // Description:
+  // Get/Set whether the point and cell data of image data is written as
+  // global 3D arrays (4D for multi-component arrays) indexed by the whole
+  // extent rather than as per-piece arrays (default off).  This allows
+  // readers to select sub-extents without reading every piece in full.  If
+  // called, it must be called BEFORE the first step.
+  vtkSetMacro(GlobalImageArrays, bool)
+  vtkGetMacro(GlobalImageArrays, bool)
+  vtkBooleanMacro(GlobalImageArrays, bool)
+
+  // Description:
+  // Get/Set whether points and cells left unchanged since they were last
+  // written are skipped rather than rewritten with every step (default off).
+  // The step at which each was last written is recorded in the file so
+  // readers can retrieve them, but readers predating this option can't.
+  // Changes are detected by object identity and modification time, so
+  // points or cells edited in place must be marked modified, or compared
+  // by content with HashGeometry.
+  vtkSetMacro(SkipUnchangedGeometry, bool)
+  vtkGetMacro(SkipUnchangedGeometry, bool)
+  vtkBooleanMacro(SkipUnchangedGeometry, bool)
+
+  // Description:
+  // Get/Set whether geometry with a new modification time is also compared
+  // by a hash of its contents before being rewritten (default off).  This
+  // catches pipelines that regenerate identical points and cells every step
+  // at the cost of a pass over the data.
+  vtkSetMacro(HashGeometry, bool)
+  vtkGetMacro(HashGeometry, bool)
+  vtkBooleanMacro(HashGeometry, bool)
+
+  // Description:
+  // Get/Set the factor applied to the size of each step when sizing the ADIOS
+  // buffer (default 1.25).  The buffer is grown between steps whenever a step
+  // would not fit.
+  vtkSetMacro(BufferHeadroom, double)
+  vtkGetMacro(BufferHeadroom, double)
+
+  // Description:
+  // Get/Set how ranks are synchronized after each step is written: with a
+  // barrier (Barrier, default), not at all (None), or once at finalization
+  // (Deferred).
+  vtkSetMacro(SynchronizationPolicy, ADIOS::SyncPolicy)
+  vtkGetMacro(SynchronizationPolicy, ADIOS::SyncPolicy)
+
+  // Description:
+  // Gather the time each rank has spent waiting in synchronization and print
+  // a per-rank report on rank 0.  This must be called on all ranks.
+  void PrintSynchronizationReport(std::ostream& os);
+
+  // Description:
+  // Get/Set whether steps are written asynchronously (default off).  When
+  // enabled, each step's data is copied into a queue and written by a
+  // background I/O thread while the pipeline continues.  Requires MPI to be
+  // initialized with MPI_THREAD_MULTIPLE.
+  vtkSetMacro(AsynchronousWrites, bool)
+  vtkGetMacro(AsynchronousWrites, bool)
+  vtkBooleanMacro(AsynchronousWrites, bool)
+
+  // Description:
+  // Get/Set the maximum number of steps queued for asynchronous writing
+  // before the pipeline blocks (default 2)
+  vtkSetMacro(WriteQueueDepth, int)
+  vtkGetMacro(WriteQueueDepth, int)
+
+  // Description:
+  // Block until all asynchronously queued steps have been written
+  bool Flush(void);
+
+  // Description:
+  // Get the currently allocated ADIOS buffer size in bytes
+  unsigned long GetBufferSize(void) const;
+
+  // Description:
+  // Get the number of steps that overflowed the ADIOS buffer, forcing it to
+  // flush part way through the step
+  unsigned long GetNumberOfBufferOverflows(void) const;
+
   // Description:
   // Set the MPI controller.
   void SetController(vtkMPIController*);
@@ -108,10 +281,15 @@ protected:
   void Define(const std::string& path, const vtkPolyData* value);
   void Define(const std::string& path, const vtkUnstructuredGrid* value);
 
+  // Description:
+  // Define image data attributes as global arrays
+  void DefineGlobal(const std::string& path, const vtkFieldData* value);
+
   // Description:
   // Open a file and prepare for writing already defined variables.
   // NOTE: The data is declared only once but the file must be opened and
-  // closed for every timestep.  Data is not flushed, however, until the final
+  // closed for every timestep.  Array sizes are written with each step so
+  // they may change over time.  Data is not flushed, however, until the final
   // destructor.
   void OpenFile(void);
   void CloseFile(void);
@@ -127,12 +305,119 @@ protected:
   void Write(const std::string& path, const vtkPolyData* value);
   void Write(const std::string& path, const vtkUnstructuredGrid* value);
 
+  // Description:
+  // Write image data attributes as global arrays given the piece and whole
+  // extents
+  void WriteGlobal(const std::string& path, const vtkFieldData* value,
+    const int extent[6], const int wholeExtent[6], bool cellData);
+
+  // Description:
+  // Determine the whole extent of the image data being written, either from
+  // the pipeline or, if not available, from the extents of all pieces
+  void GetWholeExtent(const vtkImageData* value, int wholeExtent[6]);
+
+  struct TransformRule
+  {
+    std::string Pattern;
+    int DataType;
+    vtkIdType MinSize;
+    ADIOS::Transform Transform;
+    std::string Parameters;
+    ADIOS::ErrorBound ErrorBoundMode;
+    double ErrorTolerance;
+  };
+
+  // Description:
+  // Choose the transform and its parameters for the array defined at path.
+  // For lossy transforms the error bound used is recorded in the attributes
+  // path/ErrorBoundMode and path/ErrorTolerance.
+  ADIOS::Transform DefineTransform(const std::string& path,
+    vtkAbstractArray *value, std::string& parameters);
+
+  // Description:
+  // Choose the type the array defined at path is stored as
+  int DefineStorageType(const std::string& path, vtkAbstractArray *value);
+
+  // Description:
+  // Get the data to write for the array at path, converted to its stored
+  // type in a staging buffer kept until the next step if necessary
+  const void* GetStoredData(const std::string& path,
+    vtkAbstractArray *value);
+
+  // Description:
+  // One array of a compiled write plan.  Everything that can be resolved
+  // once per array layout is: the full path, the ADIOS handle and the stored
+  // type and staging buffer.  A handle of -1 falls back to writing by path.
+  struct WritePlanEntry
+  {
+    int Index;
+    std::string Name;
+    int DataType;
+    int NumberOfComponents;
+    bool IsDataArray;
+    bool HasLookupTable;
+    bool Skip;
+    std::string Path;
+    int Handle;
+    int StoredType;
+    std::vector<char> *Staging;
+  };
+
+  // Description:
+  // Get the compiled plan for writing the arrays of the field data at path,
+  // compiling it on the first step and again only when the layout of the
+  // arrays changes
+  const std::vector<WritePlanEntry>& GetWritePlan(const std::string& path,
+    vtkFieldData *value);
+
+  // Description:
+  // Get the data to write for the array of a plan entry
+  const void* GetStoredData(const WritePlanEntry& entry,
+    vtkAbstractArray *value);
+
+  // Description:
+  // Determine whether the geometry objects written under path have changed
+  // on any rank since they were last written and get the step, among those
+  // in which they were written, at which they were last written.  This
+  // includes the current step if they have changed.
+  bool UpdateGeometry(const std::string& path,
+    const std::vector<vtkObject*>& objects, int& lastStep);
+
+  struct GeometryState
+  {
+    GeometryState() : MTime(0), Hash(0), Step(-1) { }
+    std::vector<vtkObject*> Objects;
+    unsigned long MTime;
+    vtkTypeUInt64 Hash;
+    int Step;
+  };
+
   const char *FileName;
   ADIOS::TransportMethod TransportMethod;
   const char *TransportMethodArguments;
   ADIOS::Transform Transform;
+  ADIOS::ErrorBound ErrorBoundMode;
+  double ErrorTolerance;
+  std::vector<TransformRule> TransformRules;
+  ADIOS::CellEncoding CellEncoding;
+  bool WriteCellLocations;
+  bool HomogeneousCells;
+  bool ReduceDoublePrecision;
+  bool NarrowIntegerArrays;
+  std::vector<std::pair<std::string, int> > StorageTypeRules;
+  std::map<std::string, int> StorageTypes;
+  std::map<std::string, std::vector<char> > StagingBuffers;
+  bool GlobalImageArrays;
+  bool SkipUnchangedGeometry;
+  bool HashGeometry;
+  double BufferHeadroom;
+  ADIOS::SyncPolicy SynchronizationPolicy;
+  bool AsynchronousWrites;
+  int WriteQueueDepth;
   ADIOSWriter *Writer;
   bool FirstStep;
+  std::map<std::string, GeometryState> Geometry;
+  std::map<std::string, std::vector<WritePlanEntry> > WritePlans;
   int Rank;
   vtkSmartPointer<vtkMPIController> Controller;
 
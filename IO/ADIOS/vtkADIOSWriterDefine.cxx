@@ -28,6 +28,8 @@
 #include <vtkImageData.h>
 #include <vtkPolyData.h>
 #include <vtkUnstructuredGrid.h>
+#include <vtkMPIController.h>
+#include <vtkCommunicator.h>
 
 //----------------------------------------------------------------------------
 void vtkADIOSWriter::Define(const std::string& path, const vtkAbstractArray* v)
@@ -41,11 +43,11 @@ void vtkADIOSWriter::Define(const std::string& path, const vtkAbstractArray* v)
     return;
     }
 
-  std::vector<size_t> dims;
-  dims.push_back(valueTmp->GetNumberOfComponents());
-  dims.push_back(valueTmp->GetNumberOfTuples());
-  this->Writer->DefineArray(path, dims, valueTmp->GetDataType(),
-    this->Transform);
+  // Arrays are always stored as components x tuples
+  int type = this->DefineStorageType(path, valueTmp);
+  std::string xfmParams;
+  ADIOS::Transform xfm = this->DefineTransform(path, valueTmp, xfmParams);
+  this->Writer->DefineArray(path, 2, type, xfm, xfmParams);
 }
 
 //----------------------------------------------------------------------------
@@ -72,7 +74,37 @@ void vtkADIOSWriter::Define(const std::string& path, const vtkCellArray* v)
 {
   vtkCellArray *valueTmp = const_cast<vtkCellArray*>(v);
   this->Writer->DefineScalar<vtkIdType>(path+"/NumberOfCells");
-  this->Define(path+"/IndexArray", valueTmp->GetData());
+  if(this->CellEncoding == ADIOS::CellEncoding_Legacy)
+    {
+    this->Define(path+"/IndexArray", valueTmp->GetData());
+    return;
+    }
+
+  // Encoded connectivity is written as a single component array of either
+  // 32-bit ids, if the ids of every process on the first step allow, or
+  // varint bytes
+  std::string connPath = path+"/Connectivity";
+  int type = VTK_TYPE_UINT8;
+  if(this->CellEncoding == ADIOS::CellEncoding_Compact)
+    {
+    double range[2] = { 0.0, 0.0 };
+    if(valueTmp->GetData()->GetNumberOfTuples() > 0)
+      {
+      valueTmp->GetData()->GetRange(range, 0);
+      }
+    double maxId;
+    this->Controller->AllReduce(&range[1], &maxId, 1,
+      vtkCommunicator::MAX_OP);
+    type = maxId <= VTK_TYPE_INT32_MAX ? VTK_TYPE_INT32 : VTK_ID_TYPE;
+    }
+  this->StorageTypes[connPath] = type;
+
+  this->Writer->DefineScalar<vtkTypeUInt8>(path+"/CellEncoding");
+  this->Writer->DefineScalar<int>(path+"/CellSize");
+  std::string xfmParams;
+  ADIOS::Transform xfm = this->DefineTransform(connPath,
+    valueTmp->GetData(), xfmParams);
+  this->Writer->DefineArray(connPath, 2, type, xfm, xfmParams);
 }
 
 //----------------------------------------------------------------------------
@@ -104,10 +136,58 @@ this->Define(path+"/FieldData", valueTmp->GetFieldData());
   this->Define(path+"/PointData", valueTmp->GetPointData());
 }
 
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::DefineGlobal(const std::string& path,
+  const vtkFieldData* v)
+{
+  vtkFieldData* valueTmp = const_cast<vtkFieldData*>(v);
+  for(int i = 0; i < valueTmp->GetNumberOfArrays(); ++i)
+    {
+    vtkDataArray *da = valueTmp->GetArray(i);
+    if(!da) // Only data arrays can be laid out globally
+      {
+      vtkWarningMacro(<< "Skipping non-numeric array in " << path);
+      continue;
+      }
+
+    std::string name = da->GetName() ? da->GetName() : "";
+    if(name.empty()) // skip unnamed arrays
+      {
+      vtkWarningMacro(<< "Skipping unnamed array in " << path);
+      continue;
+      }
+
+    // Arrays are stored as z x y x x, with a trailing component dimension
+    // for multi-component arrays
+    int type = this->DefineStorageType(path+"/"+name, da);
+    std::string xfmParams;
+    ADIOS::Transform xfm = this->DefineTransform(path+"/"+name, da, xfmParams);
+    this->Writer->DefineGlobalArray(path+"/"+name,
+      da->GetNumberOfComponents() > 1 ? 4 : 3, type, xfm, xfmParams);
+    }
+}
+
 //----------------------------------------------------------------------------
 void vtkADIOSWriter::Define(const std::string& path, const vtkImageData* v)
 {
-  this->Define(path+"/DataSet", static_cast<const vtkDataSet*>(v));
+  if(this->GlobalImageArrays)
+    {
+    vtkImageData *valueTmp = const_cast<vtkImageData*>(v);
+    this->Define(path+"/DataSet/FieldData", valueTmp->GetFieldData());
+    this->DefineGlobal(path+"/DataSet/CellData", valueTmp->GetCellData());
+    this->DefineGlobal(path+"/DataSet/PointData", valueTmp->GetPointData());
+
+    this->Writer->DefineScalar<int>(path+"/WholeExtentXMin");
+    this->Writer->DefineScalar<int>(path+"/WholeExtentXMax");
+    this->Writer->DefineScalar<int>(path+"/WholeExtentYMin");
+    this->Writer->DefineScalar<int>(path+"/WholeExtentYMax");
+    this->Writer->DefineScalar<int>(path+"/WholeExtentZMin");
+    this->Writer->DefineScalar<int>(path+"/WholeExtentZMax");
+    }
+  else
+    {
+    this->Define(path+"/DataSet", static_cast<const vtkDataSet*>(v));
+    }
 
   this->Writer->DefineScalar<vtkTypeUInt8>(path+"/DataObjectType");
   this->Writer->DefineScalar<double>(path+"/OriginX");
@@ -131,6 +211,8 @@ void vtkADIOSWriter::Define(const std::string& path, const vtkPolyData* v)
 
   vtkPolyData *valueTmp = const_cast<vtkPolyData*>(v);
   this->Writer->DefineScalar<vtkTypeUInt8>(path+"/DataObjectType");
+  this->Writer->DefineScalar<int>(path+"/PointsStep");
+  this->Writer->DefineScalar<int>(path+"/CellsStep");
 
   vtkPoints *p;
   if(p = valueTmp->GetPoints())
@@ -152,6 +234,8 @@ void vtkADIOSWriter::Define(const std::string& path,
 
   vtkUnstructuredGrid *valueTmp = const_cast<vtkUnstructuredGrid*>(v);
   this->Writer->DefineScalar<vtkTypeUInt8>(path+"/DataObjectType");
+  this->Writer->DefineScalar<int>(path+"/PointsStep");
+  this->Writer->DefineScalar<int>(path+"/CellsStep");
 
   vtkPoints *p;
   if(p = valueTmp->GetPoints())
@@ -164,8 +248,16 @@ void vtkADIOSWriter::Define(const std::string& path,
   vtkCellArray *ca = valueTmp->GetCells();
   if(cta && cla && ca)
     {
+    // Homogeneous grids write a single cell type in place of the array
     this->Define(path+"/CellTypes", cta);
-    this->Define(path+"/CellLocations", cla);
+    if(this->HomogeneousCells)
+      {
+      this->Writer->DefineScalar<vtkTypeUInt8>(path+"/CellType");
+      }
+    if(this->WriteCellLocations)
+      {
+      this->Define(path+"/CellLocations", cla);
+      }
     this->Define(path+"/Cells", ca);
     }
 }
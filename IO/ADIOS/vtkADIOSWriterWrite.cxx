@@ -12,6 +12,10 @@
      PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
+#include <stdexcept>
+#include <vector>
+
+#include "ADIOSUtilities.h"
 #include "ADIOSWriter.h"
 #include "vtkADIOSWriter.h"
 #include <vtkAbstractArray.h>
@@ -26,6 +30,7 @@
 #include <vtkImageData.h>
 #include <vtkPolyData.h>
 #include <vtkUnstructuredGrid.h>
+#include <vtkCellType.h>
 
 //----------------------------------------------------------------------------
 void vtkADIOSWriter::Write(const std::string& path, const vtkAbstractArray* v)
@@ -38,7 +43,10 @@ void vtkADIOSWriter::Write(const std::string& path, const vtkAbstractArray* v)
     return;
     }
 
-  this->Writer->WriteArray(path, valueTmp->GetVoidPointer(0));
+  std::vector<size_t> dims;
+  dims.push_back(valueTmp->GetNumberOfComponents());
+  dims.push_back(valueTmp->GetNumberOfTuples());
+  this->Writer->WriteArray(path, this->GetStoredData(path, valueTmp), dims);
 }
 
 //----------------------------------------------------------------------------
@@ -58,30 +66,153 @@ void vtkADIOSWriter::Write(const std::string& path, const vtkDataArray* v)
     }
 }
 
+//----------------------------------------------------------------------------
+// Get the number of points shared by every cell of a legacy connectivity
+// stream, or 0 if the cells differ in size
+static int GetUniformCellSize(const vtkIdType *ids, vtkIdType len)
+{
+  if(len == 0)
+    {
+    return 0;
+    }
+  vtkIdType npts = ids[0];
+  for(vtkIdType i = 0; i < len; i += npts+1)
+    {
+    if(ids[i] != npts)
+      {
+      return 0;
+      }
+    }
+  return static_cast<int>(npts);
+}
+
+//----------------------------------------------------------------------------
+// Append an unsigned value as a little endian base 128 varint
+static void PackVarint(std::vector<char>& buf, vtkTypeUInt64 v)
+{
+  while(v >= 0x80)
+    {
+    buf.push_back(static_cast<char>((v & 0x7F) | 0x80));
+    v >>= 7;
+    }
+  buf.push_back(static_cast<char>(v));
+}
+
+//----------------------------------------------------------------------------
+// Append an id in the stored connectivity type
+static void PackId(std::vector<char>& buf, vtkIdType id, int type)
+{
+  if(type == VTK_ID_TYPE)
+    {
+    ADIOSUtilities::Pack(buf, id);
+    }
+  else if(id <= VTK_TYPE_INT32_MAX)
+    {
+    ADIOSUtilities::Pack(buf, static_cast<vtkTypeInt32>(id));
+    }
+  else
+    {
+    throw std::runtime_error("Cell ids exceed the 32-bit connectivity "
+      "defined on the first step");
+    }
+}
+
 //----------------------------------------------------------------------------
 void vtkADIOSWriter::Write(const std::string& path, const vtkCellArray* v)
 {
   vtkCellArray* valueTmp = const_cast<vtkCellArray*>(v);
   this->Writer->WriteScalar<vtkIdType>(path+"/NumberOfCells",
     valueTmp->GetNumberOfCells());
-  this->Write(path+"/IndexArray", valueTmp->GetData());
+  if(this->CellEncoding == ADIOS::CellEncoding_Legacy)
+    {
+    this->Write(path+"/IndexArray", valueTmp->GetData());
+    return;
+    }
+
+  const vtkIdType *ids = valueTmp->GetData()->GetPointer(0);
+  vtkIdType len = valueTmp->GetNumberOfConnectivityEntries();
+  int cellSize = GetUniformCellSize(ids, len);
+  this->Writer->WriteScalar<vtkTypeUInt8>(path+"/CellEncoding",
+    this->CellEncoding);
+  this->Writer->WriteScalar<int>(path+"/CellSize", cellSize);
+
+  // Encode into a staging buffer that stays valid until the step is closed.
+  // Cell counts are only kept when the cells differ in size.
+  std::string connPath = path+"/Connectivity";
+  int type = this->StorageTypes[connPath];
+  std::vector<char> &buf = this->StagingBuffers[connPath];
+  buf.clear();
+  vtkIdType prev = 0;
+  for(vtkIdType i = 0; i < len;)
+    {
+    vtkIdType npts = ids[i++];
+    if(type == VTK_TYPE_UINT8)
+      {
+      if(!cellSize)
+        {
+        PackVarint(buf, npts);
+        }
+      for(vtkIdType j = 0; j < npts; ++j, ++i)
+        {
+        vtkTypeInt64 d = static_cast<vtkTypeInt64>(ids[i]) - prev;
+        prev = ids[i];
+        PackVarint(buf, (static_cast<vtkTypeUInt64>(d) << 1) ^
+          static_cast<vtkTypeUInt64>(d >> 63));
+        }
+      }
+    else
+      {
+      if(!cellSize)
+        {
+        PackId(buf, npts, type);
+        }
+      for(vtkIdType j = 0; j < npts; ++j, ++i)
+        {
+        PackId(buf, ids[i], type);
+        }
+      }
+    }
+
+  std::vector<size_t> dims;
+  dims.push_back(1);
+  dims.push_back(buf.size() / vtkAbstractArray::GetDataTypeSize(type));
+  this->Writer->WriteArray(connPath,
+    buf.empty() ? NULL : static_cast<const void*>(&buf[0]), dims);
 }
 
 //----------------------------------------------------------------------------
 void vtkADIOSWriter::Write(const std::string& path, const vtkFieldData* v)
 {
   vtkFieldData* valueTmp = const_cast<vtkFieldData*>(v);
-  for(size_t i = 0; i < valueTmp->GetNumberOfArrays(); ++i)
+  const std::vector<WritePlanEntry> &plan =
+    this->GetWritePlan(path, valueTmp);
+  std::vector<size_t> dims(2);
+  for(std::vector<WritePlanEntry>::const_iterator e = plan.begin();
+    e != plan.end(); ++e)
     {
-    vtkDataArray *da = valueTmp->GetArray(i);
-    vtkAbstractArray *aa = da ? da : valueTmp->GetAbstractArray(i);
+    if(e->Skip) // skip unnamed arrays
+      {
+      continue;
+      }
 
-    std::string name = aa->GetName();
-    if(name.empty()) // skip unnamed arrays
+    // Arrays with lookup tables and strings go through the general path
+    vtkAbstractArray *aa = valueTmp->GetAbstractArray(e->Index);
+    if(e->Handle < 0 || e->HasLookupTable)
       {
+      if(e->IsDataArray)
+        {
+        this->Write(e->Path, static_cast<vtkDataArray*>(aa));
+        }
+      else
+        {
+        this->Write(e->Path, aa);
+        }
       continue;
       }
-    this->Write(path+"/"+name, da ? da : aa);
+
+    dims[0] = e->NumberOfComponents;
+    dims[1] = aa->GetNumberOfTuples();
+    this->Writer->WriteArray(e->Handle, this->GetStoredData(*e, aa), dims);
     }
 }
 
@@ -96,11 +227,88 @@ void vtkADIOSWriter::Write(const std::string& path, const vtkDataSet* v)
 }
 
 //----------------------------------------------------------------------------
-void vtkADIOSWriter::Write(const std::string& path, const vtkImageData* v)
+void vtkADIOSWriter::WriteGlobal(const std::string& path,
+  const vtkFieldData* v, const int extent[6], const int wholeExtent[6],
+  bool cellData)
 {
-  this->Write(path+"/DataSet", static_cast<const vtkDataSet*>(v));
+  // Dimensions and offsets are ordered slowest to fastest varying: z, y, x
+  std::vector<size_t> dims, globalDims, offsets;
+  for(int i = 2; i >= 0; --i)
+    {
+    size_t n = extent[2*i+1] - extent[2*i] + 1;
+    size_t nGlobal = wholeExtent[2*i+1] - wholeExtent[2*i] + 1;
+    if(cellData)
+      {
+      n = n > 1 ? n-1 : 1;
+      nGlobal = nGlobal > 1 ? nGlobal-1 : 1;
+      }
+    dims.push_back(n);
+    globalDims.push_back(nGlobal);
+    offsets.push_back(extent[2*i] - wholeExtent[2*i]);
+    }
+
+  vtkFieldData* valueTmp = const_cast<vtkFieldData*>(v);
+  const std::vector<WritePlanEntry> &plan =
+    this->GetWritePlan(path, valueTmp);
+  for(std::vector<WritePlanEntry>::const_iterator e = plan.begin();
+    e != plan.end(); ++e)
+    {
+    if(e->Skip || !e->IsDataArray)
+      {
+      continue;
+      }
 
+    // Multi-component arrays get an extra, fastest varying, dimension
+    vtkAbstractArray *da = valueTmp->GetAbstractArray(e->Index);
+    dims.resize(3);
+    globalDims.resize(3);
+    offsets.resize(3);
+    if(e->NumberOfComponents > 1)
+      {
+      dims.push_back(e->NumberOfComponents);
+      globalDims.push_back(e->NumberOfComponents);
+      offsets.push_back(0);
+      }
+    const void *data = this->GetStoredData(*e, da);
+    if(e->Handle < 0)
+      {
+      this->Writer->WriteArray(e->Path, data, dims, globalDims, offsets);
+      }
+    else
+      {
+      this->Writer->WriteArray(e->Handle, data, dims, globalDims, offsets);
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkADIOSWriter::Write(const std::string& path, const vtkImageData* v)
+{
   vtkImageData* valueTmp = const_cast<vtkImageData*>(v);
+  if(this->GlobalImageArrays)
+    {
+    int wholeExtent[6];
+    this->GetWholeExtent(v, wholeExtent);
+    int *extent = valueTmp->GetExtent();
+
+    this->Write(path+"/DataSet/FieldData", valueTmp->GetFieldData());
+    this->WriteGlobal(path+"/DataSet/CellData", valueTmp->GetCellData(),
+      extent, wholeExtent, true);
+    this->WriteGlobal(path+"/DataSet/PointData", valueTmp->GetPointData(),
+      extent, wholeExtent, false);
+
+    this->Writer->WriteScalar<int>(path+"/WholeExtentXMin", wholeExtent[0]);
+    this->Writer->WriteScalar<int>(path+"/WholeExtentXMax", wholeExtent[1]);
+    this->Writer->WriteScalar<int>(path+"/WholeExtentYMin", wholeExtent[2]);
+    this->Writer->WriteScalar<int>(path+"/WholeExtentYMax", wholeExtent[3]);
+    this->Writer->WriteScalar<int>(path+"/WholeExtentZMin", wholeExtent[4]);
+    this->Writer->WriteScalar<int>(path+"/WholeExtentZMax", wholeExtent[5]);
+    }
+  else
+    {
+    this->Write(path+"/DataSet", static_cast<const vtkDataSet*>(v));
+    }
+
   this->Writer->WriteScalar<vtkTypeUInt8>(path+"/DataObjectType", VTK_IMAGE_DATA);
 
   double *origin = valueTmp->GetOrigin();
@@ -131,16 +339,38 @@ void vtkADIOSWriter::Write(const std::string& path, const vtkPolyData* v)
   this->Writer->WriteScalar<vtkTypeUInt8>(path+"/DataObjectType",
     VTK_POLY_DATA);
 
-  vtkPoints *p;
-  if(p = valueTmp->GetPoints())
+  // Geometry is only written when it has changed since the last step
+  std::vector<vtkObject*> objects;
+  int step;
+
+  vtkPoints *p = valueTmp->GetPoints();
+  if(p)
+    {
+    objects.push_back(p);
+    objects.push_back(p->GetData());
+    }
+  if(this->UpdateGeometry(path+"/Points", objects, step) && p)
     {
     this->Write(path+"/Points", p->GetData());
     }
+  this->Writer->WriteScalar<int>(path+"/PointsStep", step);
 
-  this->Write(path+"/Verticies", valueTmp->GetVerts());
-  this->Write(path+"/Lines", valueTmp->GetLines());
-  this->Write(path+"/Polygons", valueTmp->GetPolys());
-  this->Write(path+"/Strips", valueTmp->GetStrips());
+  vtkCellArray *cells[4] = { valueTmp->GetVerts(), valueTmp->GetLines(),
+    valueTmp->GetPolys(), valueTmp->GetStrips() };
+  objects.clear();
+  for(int i = 0; i < 4; ++i)
+    {
+    objects.push_back(cells[i]);
+    objects.push_back(cells[i]->GetData());
+    }
+  if(this->UpdateGeometry(path+"/Cells", objects, step))
+    {
+    this->Write(path+"/Verticies", cells[0]);
+    this->Write(path+"/Lines", cells[1]);
+    this->Write(path+"/Polygons", cells[2]);
+    this->Write(path+"/Strips", cells[3]);
+    }
+  this->Writer->WriteScalar<int>(path+"/CellsStep", step);
 }
 
 //----------------------------------------------------------------------------
@@ -153,19 +383,73 @@ void vtkADIOSWriter::Write(const std::string& path,
   this->Writer->WriteScalar<vtkTypeUInt8>(path+"/DataObjectType",
     VTK_UNSTRUCTURED_GRID);
 
-  vtkPoints *p;
-  if(p = valueTmp->GetPoints())
+  // Geometry is only written when it has changed since the last step
+  std::vector<vtkObject*> objects;
+  int step;
+
+  vtkPoints *p = valueTmp->GetPoints();
+  if(p)
+    {
+    objects.push_back(p);
+    objects.push_back(p->GetData());
+    }
+  if(this->UpdateGeometry(path+"/Points", objects, step) && p)
     {
     this->Write(path+"/Points", p->GetData());
     }
+  this->Writer->WriteScalar<int>(path+"/PointsStep", step);
 
   vtkUnsignedCharArray *cta = valueTmp->GetCellTypesArray();
   vtkIdTypeArray *cla = valueTmp->GetCellLocationsArray();
   vtkCellArray *ca = valueTmp->GetCells();
+  objects.clear();
   if(cta && cla && ca)
     {
-    this->Write(path+"/CellTypes", cta);
-    this->Write(path+"/CellLocations", cla);
+    objects.push_back(cta);
+    objects.push_back(cla);
+    objects.push_back(ca);
+    objects.push_back(ca->GetData());
+    }
+  if(this->UpdateGeometry(path+"/Cells", objects, step) && cta && cla && ca)
+    {
+    // Grids of a single cell type only record that type, or VTK_EMPTY_CELL
+    // when the types differ
+    unsigned char cellType = VTK_EMPTY_CELL;
+    vtkIdType numCells = cta->GetNumberOfTuples();
+    if(this->HomogeneousCells && numCells > 0)
+      {
+      const unsigned char *types = cta->GetPointer(0);
+      cellType = types[0];
+      for(vtkIdType i = 1; i < numCells; ++i)
+        {
+        if(types[i] != cellType)
+          {
+          cellType = VTK_EMPTY_CELL;
+          break;
+          }
+        }
+      }
+    if(this->HomogeneousCells)
+      {
+      this->Writer->WriteScalar<vtkTypeUInt8>(path+"/CellType", cellType);
+      }
+    if(cellType == VTK_EMPTY_CELL)
+      {
+      this->Write(path+"/CellTypes", cta);
+      }
+    else
+      {
+      // Keep an empty block so the array's steps stay aligned with CellsStep
+      std::vector<size_t> dims(2, 0);
+      dims[0] = 1;
+      this->Writer->WriteArray(path+"/CellTypes", cta->GetVoidPointer(0),
+        dims);
+      }
+    if(this->WriteCellLocations)
+      {
+      this->Write(path+"/CellLocations", cla);
+      }
     this->Write(path+"/Cells", ca);
     }
+  this->Writer->WriteScalar<int>(path+"/CellsStep", step);
 }